@@ -0,0 +1,60 @@
+#include "analysis.h"
+
+#include <cassert>
+#include <limits>
+
+namespace game
+{
+    Analysis::Analysis()
+        :targets(), nextPositions(), playerDist2(), closestEnemyIdx(0),
+        pointEnemyIdx(0), enemiesCentroid{0, 0}
+    {}
+
+    void Analysis::update(const WorldEval &worldEval)
+    {
+        const auto &world = worldEval.getWorld();
+        const auto &enemies = world.enemies;
+        targets.clear();
+        nextPositions.clear();
+        playerDist2.clear();
+        closestEnemyIdx = 0;
+        pointEnemyIdx = 0;
+        auto pointEnemyMinDist = numeric_limits<int64_t>::max();
+        long long int sumX = 0;
+        long long int sumY = 0;
+        for(size_t i = 0; i < enemies.size(); ++i)
+        {
+            const auto &e = enemies[i];
+            const auto ep = worldEval.getEnemyPoint(e.id);
+            // alive data points keep a target for every enemy
+            assert(ep.second);
+            const auto &target = ep.first.pos;
+            targets.push_back(target);
+            nextPositions.push_back(e.pos == target?target:
+                geom::add(e.pos, geom::mult(
+                        geom::normDirection(e.pos, target),
+                        ENEMY_STEP_DIST)));
+            playerDist2.push_back(geom::dist2(world.player.pos, e.pos));
+            if(playerDist2[i] < playerDist2[closestEnemyIdx])
+                closestEnemyIdx = i;
+            const auto d = geom::dist2(e.pos, target);
+            if(d < pointEnemyMinDist)
+            {
+                pointEnemyMinDist = d;
+                pointEnemyIdx = i;
+            }
+            sumX += e.pos.x;
+            sumY += e.pos.y;
+        }
+        if(!enemies.empty())
+        {
+            enemiesCentroid = geom::Point{
+                static_cast<int>(sumX/static_cast<long long int>(enemies.size())),
+                static_cast<int>(sumY/static_cast<long long int>(enemies.size()))};
+        }
+        else
+        {
+            enemiesCentroid = world.player.pos;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "geom.h"
+#include "game.h"
+
+namespace game
+{
+    using namespace std;
+
+    // What the command producers look at in a state, computed once per
+    // expanded node and shared by all of them. The storage is reused
+    // between updates.
+    struct Analysis
+    {
+        // data point positions the enemies move to, by enemy index
+        PointCol targets;
+        // enemy positions after a full step towards the targets
+        PointCol nextPositions;
+        // squared distances from the player, by enemy index
+        vector<int64_t> playerDist2;
+        size_t closestEnemyIdx;
+        // the enemy closest to its data point
+        size_t pointEnemyIdx;
+        // player position if there are no enemies
+        geom::Point enemiesCentroid;
+
+        Analysis();
+
+        // the game isn't finished: some data point is alive
+        void update(const WorldEval &worldEval);
+    };
+}
+
+#endif
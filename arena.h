@@ -0,0 +1,142 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <limits>
+#include <cassert>
+
+namespace arena
+{
+    using namespace std;
+
+    constexpr size_t NO_IDX = numeric_limits<size_t>::max();
+
+    // Block allocated storage addressed by index. Elements never move while
+    // the arena grows, so references stay valid until clear(). Cleared blocks
+    // are kept for reuse.
+    template<class T, size_t BLOCK_SIZE = 1024>
+    class Arena
+    {
+    public:
+        using Idx = size_t;
+
+        Arena()
+            :blocks(), count(0)
+        {}
+        Arena(const Arena&) = delete;
+        Arena &operator=(const Arena&) = delete;
+        ~Arena()
+        {
+            clear();
+        }
+
+        template<class... Args>
+        Idx emplace(Args&&... args)
+        {
+            const auto blockIdx = count/BLOCK_SIZE;
+            if(blockIdx == blocks.size())
+                blocks.emplace_back(new Storage[BLOCK_SIZE]);
+            new (&blocks[blockIdx][count%BLOCK_SIZE]) T(forward<Args>(args)...);
+            return count++;
+        }
+
+        T &operator[](Idx idx)
+        {
+            assert(idx < count);
+            return *reinterpret_cast<T*>(&blocks[idx/BLOCK_SIZE][idx%BLOCK_SIZE]);
+        }
+        const T &operator[](Idx idx) const
+        {
+            return const_cast<Arena*>(this)->operator[](idx);
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        size_t capacity() const
+        {
+            return blocks.size()*BLOCK_SIZE;
+        }
+
+        void clear()
+        {
+            for(Idx i = 0; i < count; ++i)
+                (*this)[i].~T();
+            count = 0;
+        }
+
+        void swap(Arena &that)
+        {
+            blocks.swap(that.blocks);
+            std::swap(count, that.count);
+        }
+
+    private:
+        using Storage = typename aligned_storage<sizeof(T), alignof(T)>::type;
+
+        vector<unique_ptr<Storage[]>> blocks;
+        size_t count;
+    };
+
+    // Trees stored in an arena link nodes by the parent, firstChild,
+    // lastChild and nextSibling indices.
+    template<class Node, size_t BLOCK_SIZE>
+    void appendChild(Arena<Node, BLOCK_SIZE> &nodes, size_t parent,
+        size_t child)
+    {
+        auto &p = nodes[parent];
+        if(p.lastChild != NO_IDX)
+            nodes[p.lastChild].nextSibling = child;
+        else
+            p.firstChild = child;
+        p.lastChild = child;
+    }
+
+    // Moves the subtree of root into the empty spare arena in breadth first
+    // order, so siblings stay next to each other, and swaps the arenas. The
+    // rest of the tree is destroyed. remap gets the new index of every moved
+    // node and NO_IDX for the dropped ones.
+    template<class Node, size_t BLOCK_SIZE>
+    void compactTree(Arena<Node, BLOCK_SIZE> &nodes,
+        Arena<Node, BLOCK_SIZE> &spare, size_t root, vector<size_t> &remap)
+    {
+        assert(root < nodes.size());
+        assert(spare.empty());
+        remap.assign(nodes.size(), NO_IDX);
+        remap[root] = spare.emplace(move(nodes[root]));
+        spare[0].nextSibling = NO_IDX;
+        for(size_t i = 0; i < spare.size(); ++i)
+        {
+            auto &n = spare[i];
+            const auto oldFirstChild = n.firstChild;
+            n.firstChild = NO_IDX;
+            n.lastChild = NO_IDX;
+            n.parent = (i == 0?NO_IDX:remap[n.parent]);
+            // the sibling links are set by appendChild, the old ones are
+            // still read from the moved out nodes
+            for(auto c = oldFirstChild; c != NO_IDX; c = nodes[c].nextSibling)
+            {
+                const auto idx = spare.emplace(move(nodes[c]));
+                spare[idx].nextSibling = NO_IDX;
+                remap[c] = idx;
+                appendChild(spare, i, idx);
+            }
+        }
+        nodes.swap(spare);
+        spare.clear();
+    }
+}
+
+#endif
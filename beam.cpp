@@ -0,0 +1,217 @@
+#include "beam.h"
+
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+namespace optimizer
+{
+    BeamOptimizer::BeamOptimizer(const CmdProducer &cmdProducer,
+        const BeamConfig &config)
+        :cmdProducer(cmdProducer),
+        width(max<size_t>(config.width, 1)),
+        seenStates(config.seenStatesBytes,
+            TranspositionTable::REPLACE_ALWAYS),
+        analysis(), producedCmds(), batchCmds(), step(), delta(),
+        totalBest(), totalBestCmd(game::Cmd::makeMoveCmd(geom::Point{0, 0})),
+        totalBestFound(false),
+        best(), bestCmd(game::Cmd::makeMoveCmd(geom::Point{0, 0})),
+        bestFound(false)
+    {}
+
+    pair<game::Cmd, bool> BeamOptimizer::optimize(const game::World &world,
+        chrono::milliseconds timeLimit)
+    {
+        const auto beginTime = Clock::now();
+        using SmallSnapshot = game::WorldSnapshot<8, 8>;
+        using MediumSnapshot = game::WorldSnapshot<32, 32>;
+        using LargeSnapshot = game::WorldSnapshot<128, 128>;
+        if(SmallSnapshot::fits(world))
+            return search<SmallSnapshot>(world, beginTime, timeLimit);
+        if(MediumSnapshot::fits(world))
+            return search<MediumSnapshot>(world, beginTime, timeLimit);
+        if(LargeSnapshot::fits(world))
+            return search<LargeSnapshot>(world, beginTime, timeLimit);
+        return search<game::WorldEval>(world, beginTime, timeLimit);
+    }
+
+    pair<Criteria, bool> BeamOptimizer::bestCriteria() const
+    {
+        if(bestFound)
+            return make_pair(best.criteria, true);
+        return make_pair(Criteria{}, false);
+    }
+
+    template<class Snapshot>
+    pair<game::Cmd, bool> BeamOptimizer::search(const game::World &world,
+        Clock::time_point beginTime, chrono::milliseconds timeLimit)
+    {
+        const auto deadline = beginTime + timeLimit;
+        seenStates.clear();
+        totalBestFound = false;
+        bestFound = false;
+        game::WorldEval scratch(world);
+        const SearchState rootState{0, 0};
+        vector<BeamNode<Snapshot>> layer;
+        vector<BeamNode<Snapshot>> candidates;
+        layer.push_back(BeamNode<Snapshot>{Snapshot(scratch), rootState,
+            game::Cmd::makeMoveCmd(world.player.pos),
+            makeScore(scratch, rootState)});
+        size_t depth = 0;
+        size_t worldEvals = 0;
+        while(!layer.empty())
+        {
+            if(!expandLayer(layer, candidates, scratch, deadline, depth,
+                    worldEvals))
+            {
+                break;
+            }
+            ++depth;
+            const auto greaterScore = [](const BeamNode<Snapshot> &left,
+                const BeamNode<Snapshot> &right) {
+                return lessScore(right.score, left.score);
+            };
+            if(candidates.size() > width)
+            {
+                nth_element(candidates.begin(), candidates.begin()+width,
+                    candidates.end(), greaterScore);
+                candidates.erase(candidates.begin()+width, candidates.end());
+            }
+            bestFound = false;
+            if(totalBestFound)
+            {
+                best = totalBest;
+                bestCmd = totalBestCmd;
+                bestFound = true;
+            }
+            for(const auto &n : candidates)
+                updateBest(n.score, n.firstCmd);
+            layer.swap(candidates);
+        }
+        if(totalBestFound && (!bestFound || lessScore(best, totalBest)))
+        {
+            best = totalBest;
+            bestCmd = totalBestCmd;
+            bestFound = true;
+        }
+        cerr<<"beam stats: depth="<<depth<<" time="
+            <<chrono::duration_cast<chrono::milliseconds>(Clock::now()-beginTime).count()
+            <<" evals="<<worldEvals
+            <<" width="<<width
+            <<" node bytes="<<sizeof(BeamNode<Snapshot>)
+            <<endl;
+        if(bestFound)
+        {
+            cerr<<"optimized result: "<<best.criteria<<endl;
+            return make_pair(bestCmd, true);
+        }
+        cerr<<"no optimized result"<<endl;
+        return make_pair(game::Cmd::makeMoveCmd(world.player.pos), false);
+    }
+
+    template<class Snapshot>
+    bool BeamOptimizer::expandLayer(const vector<BeamNode<Snapshot>> &layer,
+        vector<BeamNode<Snapshot>> &candidates, game::WorldEval &scratch,
+        Clock::time_point deadline, size_t depth, size_t &worldEvals)
+    {
+        candidates.clear();
+        for(const auto &node : layer)
+        {
+            if(Clock::now() >= deadline)
+                return false;
+            scratch.restore(node.world);
+            batchCmds.clear();
+            analysis.update(scratch);
+            producedCmds.clear();
+            cmdProducer(scratch, analysis, producedCmds);
+            for(const auto &c : producedCmds)
+            {
+                if(c.getType() == game::Cmd::TYPE_MOVE &&
+                    !game::insideZone(c.getMovePoint()))
+                {
+                    continue;
+                }
+                batchCmds.push_back(c);
+            }
+            const auto totalHealthBefore = scratch.getTotalHealth();
+            // siblings share the enemy movement
+            scratch.step(step);
+            for(const auto &c : batchCmds)
+            {
+                const auto valid = scratch.evalStepped(c, step, delta);
+                ++worldEvals;
+                if(valid)
+                {
+                    auto state = node.state;
+                    if(c.getType() == game::Cmd::TYPE_SHOOT)
+                    {
+                        state.totalDamage += totalHealthBefore -
+                            scratch.getTotalHealth();
+                        state.shotsFired += 1;
+                    }
+                    const auto &firstCmd = (depth == 0?c:node.firstCmd);
+                    if(seenStates.insert(makeStateHash(scratch, state), depth))
+                    {
+                        const auto score = makeScore(scratch, state);
+                        const auto &w = scratch.getWorld();
+                        if(w.enemies.empty() || w.dataPoints.empty())
+                        {
+                            updateTotalBest(score, firstCmd);
+                        }
+                        else
+                        {
+                            candidates.push_back(BeamNode<Snapshot>{
+                                Snapshot(scratch), state, firstCmd, score});
+                        }
+                    }
+                }
+                scratch.undo(delta);
+            }
+        }
+        return true;
+    }
+
+    int BeamOptimizer::calcHeuristic(const game::WorldEval &w)
+    {
+        int res = numeric_limits<int>::max();
+        for(const auto &e : w.getWorld().enemies)
+        {
+            const auto ep = w.getEnemyPoint(e.id);
+            if(ep.second)
+            {
+                res = min(res, static_cast<int>(
+                        geom::dist(e.pos, ep.first.pos))/game::ENEMY_STEP_DIST);
+            }
+        }
+        return res;
+    }
+
+    BeamOptimizer::Score BeamOptimizer::makeScore(const game::WorldEval &w,
+        const SearchState &s)
+    {
+        return Score{makeCriteria(w, s), calcHeuristic(w)};
+    }
+
+    void BeamOptimizer::updateBest(const Score &score,
+        const game::Cmd &firstCmd)
+    {
+        if(!bestFound || lessScore(best, score))
+        {
+            best = score;
+            bestCmd = firstCmd;
+            bestFound = true;
+        }
+    }
+
+    void BeamOptimizer::updateTotalBest(const Score &score,
+        const game::Cmd &firstCmd)
+    {
+        if(!totalBestFound || lessScore(totalBest, score))
+        {
+            totalBest = score;
+            totalBestCmd = firstCmd;
+            totalBestFound = true;
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef BEAM_H
+#define BEAM_H
+
+#include <vector>
+#include <chrono>
+#include <ostream>
+
+#include "game.h"
+#include "optimizer.h"
+#include "transposition.h"
+
+namespace optimizer
+{
+    using namespace std;
+
+    struct BeamConfig
+    {
+        BeamConfig()
+            :width(256), seenStatesBytes(4*1024*1024)
+        {}
+
+        // nodes kept per depth
+        size_t width;
+        size_t seenStatesBytes;
+    };
+
+    // Breadth limited search: every depth keeps only the best width nodes
+    // ordered by Criteria and a heuristic. Trades breadth for depth under the
+    // same time limit. Nodes are stored as fixed size snapshots chosen by
+    // the scenario size, children are evaluated on one scratch world.
+    class BeamOptimizer: public Engine
+    {
+    public:
+        BeamOptimizer(const CmdProducer &cmdProducer,
+            const BeamConfig &config = BeamConfig());
+        BeamOptimizer(const BeamOptimizer&) = delete;
+        BeamOptimizer &operator=(const BeamOptimizer&) = delete;
+
+        pair<game::Cmd, bool> optimize(const game::World &world,
+            chrono::milliseconds timeLimit) override;
+
+        pair<Criteria, bool> bestCriteria() const override;
+
+    private:
+        struct Score
+        {
+            Criteria criteria;
+            int heuristic;
+        };
+        static bool lessScore(const Score &left, const Score &right)
+        {
+            return left.criteria < right.criteria ||
+                (!(right.criteria < left.criteria) &&
+                 left.heuristic < right.heuristic);
+        }
+
+        template<class Snapshot>
+        struct BeamNode
+        {
+            Snapshot world;
+            SearchState state;
+            game::Cmd firstCmd;
+            Score score;
+        };
+
+        // turns until the first enemy reaches its data point, more is better
+        static int calcHeuristic(const game::WorldEval &w);
+        static Score makeScore(const game::WorldEval &w, const SearchState &s);
+        template<class Snapshot>
+        pair<game::Cmd, bool> search(const game::World &world,
+            Clock::time_point beginTime, chrono::milliseconds timeLimit);
+        // expands the layer into candidates, returns false on timeout
+        template<class Snapshot>
+        bool expandLayer(const vector<BeamNode<Snapshot>> &layer,
+            vector<BeamNode<Snapshot>> &candidates, game::WorldEval &scratch,
+            Clock::time_point deadline, size_t depth, size_t &worldEvals);
+        void updateBest(const Score &score, const game::Cmd &firstCmd);
+        void updateTotalBest(const Score &score, const game::Cmd &firstCmd);
+
+        CmdProducer cmdProducer;
+        size_t width;
+        TranspositionTable seenStates;
+        // scratch for the children of one node
+        game::Analysis analysis;
+        CmdBuffer producedCmds;
+        vector<game::Cmd> batchCmds;
+        game::WorldEval::Step step;
+        game::WorldEval::Delta delta;
+        // best finished game and best node of the last complete layer
+        Score totalBest;
+        game::Cmd totalBestCmd;
+        bool totalBestFound;
+        Score best;
+        game::Cmd bestCmd;
+        bool bestFound;
+    };
+}
+
+#endif
@@ -2,8 +2,6 @@
 
 #include <cstddef>
 #include <algorithm>
-#include <unordered_set>
-#include <unordered_map>
 #include <cassert>
 #include <cmath>
 #include <algorithm>
@@ -24,6 +22,100 @@ namespace game
                 return left.id < right.id;
             }
         };
+
+        hashing::Hash enemyHash(int id, int life, const geom::Point &pos)
+        {
+            return hashing::combineHash(
+                (static_cast<hashing::Hash>(static_cast<uint32_t>(id)) << 32) |
+                static_cast<uint32_t>(life),
+                (static_cast<hashing::Hash>(static_cast<uint32_t>(pos.x)) << 32) |
+                static_cast<uint32_t>(pos.y));
+        }
+
+        hashing::Hash enemyHash(const Enemy &e)
+        {
+            return enemyHash(e.id, e.life, e.pos);
+        }
+
+        shared_ptr<const geom::PointGrid> makePointGrid(
+            const DataPointCol &points)
+        {
+            geom::PointGrid::EntryCol entries;
+            for(const auto &p : points)
+                entries.push_back(geom::PointGrid::Entry{p.id, p.pos});
+            return make_shared<const geom::PointGrid>(entries);
+        }
+
+        int exactDamage(int64_t dist2)
+        {
+            return round(125000.0/
+                pow(sqrt(static_cast<double>(dist2)), 1.2));
+        }
+
+        // Damage by squared distance in buckets where it drops at most by
+        // one, the drop position is stored. Buckets close to the player
+        // drop faster and are left to exactDamage.
+        class DamageTable
+        {
+        public:
+            DamageTable()
+                :buckets((MAX_DIST2 >> SHIFT) + 1, Bucket{-1, 0})
+            {
+                // the first bucket holds the zero distance
+                for(size_t b = 1; b < buckets.size(); ++b)
+                {
+                    const int64_t first = static_cast<int64_t>(b) << SHIFT;
+                    const int64_t last = first + (1 << SHIFT) - 1;
+                    const auto firstDamage = exactDamage(first);
+                    const auto lastDamage = exactDamage(last);
+                    if(firstDamage == lastDamage)
+                    {
+                        buckets[b] = Bucket{firstDamage,
+                            static_cast<uint32_t>(last+1)};
+                    }
+                    else if(firstDamage == lastDamage+1)
+                    {
+                        // first distance with lastDamage
+                        int64_t lo = first+1;
+                        int64_t hi = last;
+                        while(lo < hi)
+                        {
+                            const auto mid = lo + (hi-lo)/2;
+                            if(exactDamage(mid) == lastDamage)
+                                hi = mid;
+                            else
+                                lo = mid+1;
+                        }
+                        buckets[b] = Bucket{firstDamage,
+                            static_cast<uint32_t>(lo)};
+                    }
+                }
+            }
+
+            bool lookup(int64_t dist2, int &damage) const
+            {
+                const auto b = static_cast<uint64_t>(dist2) >> SHIFT;
+                if(b >= buckets.size() || buckets[b].damage < 0)
+                    return false;
+                const auto &bucket = buckets[b];
+                damage = (dist2 < bucket.drop?bucket.damage:bucket.damage-1);
+                return true;
+            }
+
+        private:
+            static const int SHIFT = 16;
+            static const int64_t MAX_DIST2 =
+                static_cast<int64_t>(ZONE.x)*ZONE.x +
+                static_cast<int64_t>(ZONE.y)*ZONE.y;
+
+            struct Bucket
+            {
+                int damage;
+                uint32_t drop;
+            };
+
+            vector<Bucket> buckets;
+        };
     }
 
     ostream &operator<<(ostream &stream, const game::Enemy &enemy)
@@ -38,8 +130,10 @@ namespace game
     }
 
     WorldEval::WorldEval(const World &world)
-        :world(world), enemiesById(), pointsById(), enemyPoints(),
-        totalHealth(0),
+        :world(world), enemyLanes(), pointGrid(makePointGrid(world.dataPoints)),
+        enemiesById(), pointsById(),
+        enemyPoints(),
+        totalHealth(0), enemiesHash(0), enemyIdsHash(0), dataPointIdsHash(0),
         maxEnemyId(!world.enemies.empty()
             ?max_element(world.enemies.begin(), world.enemies.end(), ExtractId())->id
             :0),
@@ -52,59 +146,117 @@ namespace game
         enemyPoints.resize(getMaxEnemyId()+1, -1);
         for(const auto &e : this->world.enemies)
         {
-            enemyPoints[e.id] = closestDataPoint(e.pos, this->world);
+            enemyPoints[e.id] = closestDataPoint(e.pos);
+            assert(enemyPoints[e.id] >= 0);
             totalHealth += e.life;
+            enemyLanes.x.push_back(e.pos.x);
+            enemyLanes.y.push_back(e.pos.y);
+            enemiesHash ^= enemyHash(e);
+            enemyIdsHash ^= hashing::mixHash(e.id);
         }
+        for(const auto &p : this->world.dataPoints)
+            dataPointIdsHash ^= hashing::mixHash(p.id);
     }
 
-    int WorldEval::closestDataPoint(const geom::Point &pos, const World &w)
+    bool WorldEval::eval(const Cmd &cmd)
     {
-        auto closestPointIter = min_element(
-            w.dataPoints.begin(), w.dataPoints.end(),
-            [&pos](const DataPointCol::value_type &left,
-                const DataPointCol::value_type &right) {
-            const auto leftDist = geom::dist(left.pos, pos);
-            const auto rightDist = geom::dist(right.pos, pos);
-            return leftDist < rightDist ||
-            (leftDist == rightDist && left.id < right.id);
-            });
-        assert(closestPointIter != w.dataPoints.end());
-        return closestPointIter->id;
+        static thread_local CaptureCol captures;
+        captures.clear();
+        moveEnemies(nullptr, captures);
+        return applyCmd(cmd, captures, nullptr);
     }
 
-    bool WorldEval::eval(const Cmd &cmd)
+    bool WorldEval::eval(const Cmd &cmd, Delta &delta)
+    {
+        delta.clear();
+        static thread_local CaptureCol captures;
+        captures.clear();
+        moveEnemies(&delta.enemyShifts, captures);
+        return applyCmd(cmd, captures, &delta);
+    }
+
+    void WorldEval::step(Step &step)
+    {
+        step.enemyShifts.clear();
+        step.captures.clear();
+        moveEnemies(&step.enemyShifts, step.captures);
+    }
+
+    bool WorldEval::evalStepped(const Cmd &cmd, const Step &step)
+    {
+        return applyCmd(cmd, step.captures, nullptr);
+    }
+
+    bool WorldEval::evalStepped(const Cmd &cmd, const Step &step, Delta &delta)
+    {
+        delta.clear();
+        return applyCmd(cmd, step.captures, &delta);
+    }
+
+    void WorldEval::moveEnemies(Delta::ShiftCol *shifts, CaptureCol &captures)
     {
-        using IdSet = unordered_set<int>;
-        using PointEnemiesMap = unordered_map<int, IdSet>;
-        PointEnemiesMap pointEnemies;
         if(!world.dataPoints.empty())
         {
-            for(size_t i = 0; i < world.enemies.size(); ++i)
+            // data point positions by enemy index
+            static thread_local EnemyLanes targets;
+            static thread_local vector<unsigned char> reached;
+            const auto count = world.enemies.size();
+            targets.x.resize(count);
+            targets.y.resize(count);
+            reached.resize(count);
+            for(size_t i = 0; i < count; ++i)
             {
-                const auto &e = world.enemies[i];
-                const auto enemyPointId = findEnemyPoint(e.id);
+                const auto enemyPointId = findEnemyPoint(world.enemies[i].id);
                 assert(enemyPointId >= 0);
                 const auto *closestPointPtr = findDataPoint(enemyPointId);
                 assert(closestPointPtr != nullptr);
-                const auto &closestPoint = *closestPointPtr;
-                if(static_cast<int>(geom::dist(closestPoint.pos, e.pos)) <= game::ENEMY_STEP_DIST)
-                {
-                    world.enemies[i].pos = closestPoint.pos;
-                    pointEnemies[closestPoint.id].insert(e.id);
-                }
-                else
+                targets.x[i] = closestPointPtr->pos.x;
+                targets.y[i] = closestPointPtr->pos.y;
+            }
+            lanes::moveTowards(enemyLanes.x.data(), enemyLanes.y.data(),
+                targets.x.data(), targets.y.data(), count,
+                game::ENEMY_STEP_DIST, reached.data());
+            for(size_t i = 0; i < count; ++i)
+            {
+                auto &e = world.enemies[i];
+                const geom::Point nextPos{enemyLanes.x[i], enemyLanes.y[i]};
+                if(shifts)
                 {
-                    const auto direction = geom::normDirection(
-                        e.pos, closestPoint.pos);
-                    world.enemies[i].pos = geom::add(world.enemies[i].pos,
-                        geom::mult(direction, game::ENEMY_STEP_DIST));
+                    shifts->push_back(Delta::Shift{
+                        static_cast<int16_t>(nextPos.x - e.pos.x),
+                        static_cast<int16_t>(nextPos.y - e.pos.y)});
                 }
+                enemiesHash ^= enemyHash(e) ^ enemyHash(e.id, e.life, nextPos);
+                e.pos = nextPos;
+                if(reached[i])
+                    captures.push_back(Capture{findEnemyPoint(e.id), e.id});
             }
         }
+    }
+
+    void WorldEval::shiftEnemies(const Delta::ShiftCol &shifts, int sign)
+    {
+        for(size_t i = 0; i < shifts.size(); ++i)
+        {
+            auto &e = world.enemies[i];
+            auto &pos = e.pos;
+            enemiesHash ^= enemyHash(e);
+            pos.x += sign*shifts[i].dx;
+            pos.y += sign*shifts[i].dy;
+            enemiesHash ^= enemyHash(e);
+            enemyLanes.x[i] = pos.x;
+            enemyLanes.y[i] = pos.y;
+        }
+    }
+
+    bool WorldEval::applyCmd(const Cmd &cmd, const CaptureCol &captures,
+        Delta *delta)
+    {
         if(cmd.getType() == Cmd::TYPE_MOVE)
         {
-            if(geom::dist(world.player.pos, cmd.getMovePoint()) >
-                game::PLAYER_STEP_DIST)
+            const auto prevPos = world.player.pos;
+            if(!geom::withinDist(world.player.pos, cmd.getMovePoint(),
+                    game::PLAYER_STEP_DIST))
             {
                 const auto direction = geom::normDirection(
                     world.player.pos, cmd.getMovePoint());
@@ -128,15 +280,18 @@ namespace game
                 world.player.pos.y =
                     min(max(0, world.player.pos.y), game::ZONE.y);
             }
-        }
-        for(const auto &e : world.enemies)
-        {
-            // TODO: floating equality
-            if(geom::dist(world.player.pos, e.pos) <= game::DEATH_DIST)
+            if(delta)
             {
-                return false;
+                delta->playerShift = geom::Point{
+                    world.player.pos.x - prevPos.x,
+                    world.player.pos.y - prevPos.y};
             }
         }
+        if(lanes::anyWithin(enemyLanes.x.data(), enemyLanes.y.data(),
+                world.enemies.size(), world.player.pos, game::DEATH_DIST))
+        {
+            return false;
+        }
         int deadEnemyId = -1;
         if(cmd.getType() == Cmd::TYPE_SHOOT)
         {
@@ -145,45 +300,66 @@ namespace game
             assert(enemyPtr != nullptr);
             auto &enemy = *enemyPtr;
             const int damage = calcDamage(world.player.pos, enemy.pos);
+            if(delta)
+                delta->shotEnemyId = enemy.id;
             if(enemy.life > damage)
             {
+                enemiesHash ^= enemyHash(enemy) ^
+                    enemyHash(enemy.id, enemy.life - damage, enemy.pos);
                 enemy.life -= damage;
                 assert(totalHealth >= damage);
                 totalHealth -= damage;
+                if(delta)
+                    delta->damage = damage;
             }
             else
             {
                 deadEnemyId = enemy.id;
+                if(delta)
+                {
+                    delta->damage = enemy.life;
+                    delta->killedIdx = enemyIdx(deadEnemyId);
+                    delta->killedEnemy = enemy;
+                    delta->killedPoint = findEnemyPoint(deadEnemyId);
+                }
                 const auto removed = eraseEnemyPoint(deadEnemyId);
                 assert(removed);
+                (void)removed;
                 assert(totalHealth >= enemy.life);
                 totalHealth -= enemy.life;
                 const auto r = eraseEnemy(deadEnemyId);
                 assert(r);
+                (void)r;
             }
         }
-        DataPointCol nextPoints;
-        bool pointsChanged = false;
-        for(const auto &p : world.dataPoints)
+        // captured points are removed in place keeping the order
+        size_t keptPoints = 0;
+        size_t firstRemoved = world.dataPoints.size();
+        for(size_t i = 0; i < world.dataPoints.size(); ++i)
         {
-            auto iter = pointEnemies.find(p.id);
-            if(iter != pointEnemies.end() && deadEnemyId != -1)
-            {
-                iter->second.erase(deadEnemyId);
-            }
-            if(iter == pointEnemies.end() || iter->second.empty())
+            const auto &p = world.dataPoints[i];
+            const auto captured = any_of(captures.begin(), captures.end(),
+                [&p, deadEnemyId](const Capture &c) {
+                return c.pointId == p.id && c.enemyId != deadEnemyId;
+                });
+            if(!captured)
             {
-                nextPoints.push_back(p);
+                world.dataPoints[keptPoints++] = p;
             }
             else
             {
-                pointsChanged = true;
+                firstRemoved = min(firstRemoved, i);
+                pointsById[p.id] = -1;
+                dataPointIdsHash ^= hashing::mixHash(p.id);
+                if(delta)
+                    delta->removedPoints.push_back(Delta::RemovedPoint{i, p});
             }
         }
-        if(pointsChanged)
+        if(keptPoints != world.dataPoints.size())
         {
-            world.dataPoints = move(nextPoints);
-            indexDataPoints();
+            world.dataPoints.erase(world.dataPoints.begin() + keptPoints,
+                world.dataPoints.end());
+            reindexDataPoints(firstRemoved);
             if(!world.dataPoints.empty())
             {
                 for(auto &e : world.enemies)
@@ -191,17 +367,131 @@ namespace game
                     const auto enemyPointId = findEnemyPoint(e.id);
                     assert(enemyPointId >= 0);
                     if(findDataPoint(enemyPointId) == nullptr)
-                        enemyPoints[e.id] = closestDataPoint(e.pos, world);
+                    {
+                        enemyPoints[e.id] = closestDataPoint(e.pos);
+                        if(delta)
+                        {
+                            delta->retargets.push_back(Delta::Retarget{
+                                e.id, enemyPointId, enemyPoints[e.id]});
+                        }
+                    }
                 }
             }
             else
             {
+                if(delta)
+                {
+                    for(const auto &e : world.enemies)
+                    {
+                        delta->retargets.push_back(Delta::Retarget{
+                            e.id, findEnemyPoint(e.id), -1});
+                    }
+                }
                 clearEnemyPoints();
             }
         }
         return true;
     }
 
+    void WorldEval::apply(const Delta &delta)
+    {
+        assert(delta.enemyShifts.empty() ||
+            delta.enemyShifts.size() == world.enemies.size());
+        shiftEnemies(delta.enemyShifts, 1);
+        world.player.pos.x += delta.playerShift.x;
+        world.player.pos.y += delta.playerShift.y;
+        if(delta.shotEnemyId >= 0)
+        {
+            totalHealth -= delta.damage;
+            if(delta.killedIdx >= 0)
+            {
+                enemyPoints[delta.shotEnemyId] = -1;
+                const auto r = eraseEnemy(delta.shotEnemyId);
+                assert(r);
+                (void)r;
+            }
+            else
+            {
+                auto *enemyPtr = findEnemy(delta.shotEnemyId);
+                assert(enemyPtr != nullptr);
+                enemiesHash ^= enemyHash(*enemyPtr);
+                enemyPtr->life -= delta.damage;
+                enemiesHash ^= enemyHash(*enemyPtr);
+            }
+        }
+        if(!delta.removedPoints.empty())
+        {
+            for(auto iter = delta.removedPoints.rbegin();
+                iter != delta.removedPoints.rend(); ++iter)
+            {
+                pointsById[iter->point.id] = -1;
+                dataPointIdsHash ^= hashing::mixHash(iter->point.id);
+                world.dataPoints.erase(world.dataPoints.begin() + iter->idx);
+            }
+            reindexDataPoints(delta.removedPoints.front().idx);
+        }
+        for(const auto &r : delta.retargets)
+            enemyPoints[r.enemyId] = r.to;
+    }
+
+    void WorldEval::apply(const Step &step)
+    {
+        assert(step.enemyShifts.size() == world.enemies.size());
+        shiftEnemies(step.enemyShifts, 1);
+    }
+
+    void WorldEval::undo(const Step &step)
+    {
+        assert(step.enemyShifts.size() == world.enemies.size());
+        shiftEnemies(step.enemyShifts, -1);
+    }
+
+    void WorldEval::undo(const Delta &delta)
+    {
+        for(const auto &r : delta.retargets)
+            enemyPoints[r.enemyId] = r.from;
+        if(!delta.removedPoints.empty())
+        {
+            for(const auto &r : delta.removedPoints)
+            {
+                world.dataPoints.insert(world.dataPoints.begin() + r.idx,
+                    r.point);
+                dataPointIdsHash ^= hashing::mixHash(r.point.id);
+            }
+            reindexDataPoints(delta.removedPoints.front().idx);
+        }
+        if(delta.shotEnemyId >= 0)
+        {
+            totalHealth += delta.damage;
+            if(delta.killedIdx >= 0)
+            {
+                world.enemies.insert(world.enemies.begin() + delta.killedIdx,
+                    delta.killedEnemy);
+                enemyLanes.x.insert(enemyLanes.x.begin() + delta.killedIdx,
+                    delta.killedEnemy.pos.x);
+                enemyLanes.y.insert(enemyLanes.y.begin() + delta.killedIdx,
+                    delta.killedEnemy.pos.y);
+                reindexEnemies(delta.killedIdx);
+                enemiesHash ^= enemyHash(delta.killedEnemy);
+                enemyIdsHash ^= hashing::mixHash(delta.killedEnemy.id);
+                enemyPoints[delta.shotEnemyId] = delta.killedPoint;
+            }
+            else
+            {
+                auto *enemyPtr = findEnemy(delta.shotEnemyId);
+                assert(enemyPtr != nullptr);
+                enemiesHash ^= enemyHash(*enemyPtr);
+                enemyPtr->life += delta.damage;
+                enemiesHash ^= enemyHash(*enemyPtr);
+            }
+        }
+        world.player.pos.x -= delta.playerShift.x;
+        world.player.pos.y -= delta.playerShift.y;
+        assert(delta.enemyShifts.empty() ||
+            delta.enemyShifts.size() == world.enemies.size());
+        shiftEnemies(delta.enemyShifts, -1);
+    }
+
     pair<DataPoint, bool> WorldEval::getEnemyPoint(const int enemyId) const
     {
         const DataPoint defaultPoint{0, geom::Point{0, 0}};
@@ -227,8 +517,13 @@ namespace game
         const auto idx = enemyIdx(enemyId);
         if(idx >= 0)
         {
+            enemiesHash ^= enemyHash(world.enemies[idx]);
+            enemyIdsHash ^= hashing::mixHash(enemyId);
             world.enemies.erase(world.enemies.begin() + idx);
-            indexEnemies();
+            enemyLanes.x.erase(enemyLanes.x.begin() + idx);
+            enemyLanes.y.erase(enemyLanes.y.begin() + idx);
+            enemiesById[enemyId] = -1;
+            reindexEnemies(idx);
             return true;
         }
         return false;
@@ -278,13 +573,22 @@ namespace game
 
     void WorldEval::clearEnemyPoints()
     {
-        enemyPoints.clear();
-        enemyPoints.resize(getMaxEnemyId()+1, -1);
+        fill(enemyPoints.begin(), enemyPoints.end(), -1);
     }
 
     int WorldEval::calcDamage(const geom::Point &player, const geom::Point &enemy)
     {
-        return round(125000.0/
-            pow(geom::dist(player, enemy), 1.2));
+        const int64_t dx = player.x - enemy.x;
+        const int64_t dy = player.y - enemy.y;
+        return calcDamageDist2(dx*dx + dy*dy);
+    }
+
+    int WorldEval::calcDamageDist2(int64_t dist2)
+    {
+        static const DamageTable table;
+        int damage = 0;
+        if(table.lookup(dist2, damage))
+            return damage;
+        return exactDamage(dist2);
     }
 }
@@ -2,15 +2,23 @@
 #define GAME_H
 
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
 #include <chrono>
 #include <stdexcept>
 #include <string>
 #include <tuple>
 #include <unordered_map>
 #include <utility>
+#include <memory>
 #include <ostream>
+#include <cassert>
 
 #include "geom.h"
+#include "grid.h"
+#include "hash.h"
+#include "lanes.h"
 
 namespace game
 {
@@ -89,18 +97,18 @@ namespace game
             return data.id;
         }
 
-        const string &getComment() const
+        const char *getComment() const
         {
             return comment;
         }
 
-        static Cmd makeMoveCmd(const geom::Point &p, const string &comment=string())
+        static Cmd makeMoveCmd(const geom::Point &p, const char *comment="")
         {
             Data d;
             d.pos = p;
             return Cmd(TYPE_MOVE, d, comment);
         }
-        static Cmd makeShootCmd(int id, const string &comment=string())
+        static Cmd makeShootCmd(int id, const char *comment="")
         {
             Data d;
             d.id = id;
@@ -115,13 +123,28 @@ namespace game
         };
         Type type;
         Data data;
-        string comment;
+        // a string literal, keeps the command trivially copyable
+        const char *comment;
 
     private:
-        Cmd(Type type, const Data &data, const string &comment)
+        Cmd(Type type, const Data &data, const char *comment)
             :type(type), data(data), comment(comment){}
     };
 
+    // the comments are ignored
+    inline bool operator==(const Cmd &left, const Cmd &right)
+    {
+        if(left.getType() != right.getType())
+            return false;
+        if(left.getType() == Cmd::TYPE_MOVE)
+            return left.getMovePoint() == right.getMovePoint();
+        return left.getShootId() == right.getShootId();
+    }
+    inline bool operator!=(const Cmd &left, const Cmd &right)
+    {
+        return !(left == right);
+    }
+
     using PointCol = vector<geom::Point>;
     using EnemyCol = vector<Enemy>;
     using DataPointCol = vector<DataPoint>;
@@ -147,13 +170,121 @@ namespace game
     const int ENEMY_STEP_DIST = 500;
     constexpr geom::Point ZONE{16000, 9000};
     constexpr chrono::milliseconds TIME_LIMIT(100);
+    // the response to the first turn may take longer
+    constexpr chrono::milliseconds FIRST_TIME_LIMIT(1000);
+
+    constexpr bool insideZone(const geom::Point &p)
+    {
+        return p.x >= 0 && p.x <= ZONE.x &&
+            p.y >= 0 && p.y <= ZONE.y;
+    }
+
+    template<size_t MAX_ENEMIES, size_t MAX_POINTS>
+    struct WorldSnapshot;
 
     class WorldEval
     {
     public:
+        // changes made by one eval, enough to apply them again or undo them
+        struct Delta
+        {
+            struct Shift
+            {
+                int16_t dx;
+                int16_t dy;
+            };
+            struct RemovedPoint
+            {
+                size_t idx;
+                DataPoint point;
+            };
+            struct Retarget
+            {
+                int enemyId;
+                int from;
+                int to;
+            };
+            using ShiftCol = vector<Shift>;
+            using RemovedPointCol = vector<RemovedPoint>;
+            using RetargetCol = vector<Retarget>;
+
+            Delta()
+                :enemyShifts(), playerShift{0, 0}, shotEnemyId(-1), damage(0),
+                killedIdx(-1), killedEnemy{0, 0, geom::Point{0, 0}},
+                killedPoint(-1), removedPoints(), retargets()
+            {}
+
+            void clear()
+            {
+                enemyShifts.clear();
+                playerShift = geom::Point{0, 0};
+                shotEnemyId = -1;
+                damage = 0;
+                killedIdx = -1;
+                killedPoint = -1;
+                removedPoints.clear();
+                retargets.clear();
+            }
+
+            // storage outside of the struct
+            size_t heapBytes() const
+            {
+                return enemyShifts.capacity()*sizeof(Shift) +
+                    removedPoints.capacity()*sizeof(RemovedPoint) +
+                    retargets.capacity()*sizeof(Retarget);
+            }
+
+            // by enemy index before the command
+            ShiftCol enemyShifts;
+            geom::Point playerShift;
+            int shotEnemyId;
+            int damage;
+            int killedIdx;
+            Enemy killedEnemy;
+            int killedPoint;
+            // ascending indices before the removal
+            RemovedPointCol removedPoints;
+            RetargetCol retargets;
+        };
+
+        struct Capture
+        {
+            int pointId;
+            int enemyId;
+        };
+        using CaptureCol = vector<Capture>;
+        // Enemy movement of an eval. It doesn't depend on the command, so
+        // it's shared by every command evaluated from the same state.
+        struct Step
+        {
+            size_t heapBytes() const
+            {
+                return enemyShifts.capacity()*sizeof(Delta::Shift) +
+                    captures.capacity()*sizeof(Capture);
+            }
+
+            Delta::ShiftCol enemyShifts;
+            CaptureCol captures;
+        };
+
         WorldEval(const World &world);
 
         bool eval(const Cmd &cmd);
+        // records the changes into delta, also when the player is killed
+        bool eval(const Cmd &cmd, Delta &delta);
+        // repeats an eval recorded from the current state
+        void apply(const Delta &delta);
+        // reverts an eval recorded from the previous state
+        void undo(const Delta &delta);
+
+        // eval split in two: step moves the enemies, evalStepped applies
+        // the command to the stepped state, the delta doesn't include the
+        // enemy shifts
+        void step(Step &step);
+        bool evalStepped(const Cmd &cmd, const Step &step);
+        bool evalStepped(const Cmd &cmd, const Step &step, Delta &delta);
+        void apply(const Step &step);
+        void undo(const Step &step);
 
         const World &getWorld() const
         {
@@ -167,6 +298,14 @@ namespace game
 
         pair<DataPoint, bool> getEnemyPoint(const int enemyId) const;
 
+        // also for ids of another world of the game
+        bool enemyAlive(int enemyId) const
+        {
+            return enemyId >= 0 &&
+                static_cast<size_t>(enemyId) < enemiesById.size() &&
+                enemiesById[enemyId] >= 0;
+        }
+
         size_t getMaxEnemyId() const
         {
             return maxEnemyId;
@@ -177,7 +316,63 @@ namespace game
             return maxDataPointId;
         }
 
+        // id of the closest alive data point, the smaller id on equal
+        // distances, -1 if there are no data points
+        int closestDataPoint(const geom::Point &pos) const
+        {
+            return pointGrid->closest(pos, [this](int id) {
+                return pointsById[id] >= 0;
+                });
+        }
+
+        // Zobrist style hashes kept up to date by eval, step, apply and
+        // undo. hash covers the whole world and can key the states across
+        // the turns, the id hashes only tell which enemies and data points
+        // are alive.
+        hashing::Hash hash() const
+        {
+            const auto playerKey =
+                (static_cast<hashing::Hash>(static_cast<uint32_t>(
+                            world.player.pos.x)) << 32) |
+                static_cast<uint32_t>(world.player.pos.y);
+            return hashing::combineHash(hashing::combineHash(
+                    hashing::mixHash(playerKey), enemiesHash),
+                dataPointIdsHash);
+        }
+
+        hashing::Hash getEnemyIdsHash() const
+        {
+            return enemyIdsHash;
+        }
+
+        hashing::Hash getDataPointIdsHash() const
+        {
+            return dataPointIdsHash;
+        }
+
+        // A snapshot keeps the mutable state in inline storage, it must
+        // fit the world. restore takes a snapshot of the same game.
+        template<size_t MAX_ENEMIES, size_t MAX_POINTS>
+        void save(WorldSnapshot<MAX_ENEMIES, MAX_POINTS> &snapshot) const;
+        template<size_t MAX_ENEMIES, size_t MAX_POINTS>
+        void restore(const WorldSnapshot<MAX_ENEMIES, MAX_POINTS> &snapshot);
+        // worlds too large for the snapshots are stored as they are
+        void restore(const WorldEval &that)
+        {
+            *this = that;
+        }
+
+        // the data point must be alive
+        const DataPoint &getDataPoint(int dataPointId) const
+        {
+            const auto *pointPtr = findDataPoint(dataPointId);
+            assert(pointPtr != nullptr);
+            return *pointPtr;
+        }
+
         static int calcDamage(const geom::Point &player, const geom::Point &enemy);
+        // same as calcDamage for points at the squared distance dist2
+        static int calcDamageDist2(int64_t dist2);
 
     private:
         using IdIdxCol = vector<int>;
@@ -202,6 +397,26 @@ namespace game
             }
         }
 
+        // updates the indices of the elements moved by an insertion or
+        // removal at idx, the removed ids are reset by the caller
+        void reindexEnemies(size_t idx)
+        {
+            for(size_t i = idx; i < world.enemies.size(); ++i)
+                enemiesById[world.enemies[i].id] = i;
+        }
+
+        void reindexDataPoints(size_t idx)
+        {
+            for(size_t i = idx; i < world.dataPoints.size(); ++i)
+                pointsById[world.dataPoints[i].id] = i;
+        }
+
+        void moveEnemies(Delta::ShiftCol *shifts, CaptureCol &captures);
+        // sign is 1 to apply the shifts and -1 to undo them
+        void shiftEnemies(const Delta::ShiftCol &shifts, int sign);
+        bool applyCmd(const Cmd &cmd, const CaptureCol &captures,
+            Delta *delta);
+
         Enemy *findEnemy(int enemyId);
         const Enemy *findEnemy(int enemyId) const
         {
@@ -221,16 +436,102 @@ namespace game
         bool eraseEnemyPoint(int enemyId);
         void clearEnemyPoints();
 
-        static int closestDataPoint(const geom::Point &pos, const World &w);
-
         World world;
+        // mirrors the enemy positions of world
+        EnemyLanes enemyLanes;
+        // initial data points, shared by the copies
+        shared_ptr<const geom::PointGrid> pointGrid;
         IdIdxCol enemiesById;
         IdIdxCol pointsById;
         IdIdxCol enemyPoints;
         int totalHealth;
+        // xor of the hashes of the alive enemies with their positions and
+        // lives, and of the alive ids
+        hashing::Hash enemiesHash;
+        hashing::Hash enemyIdsHash;
+        hashing::Hash dataPointIdsHash;
         size_t maxEnemyId;
         size_t maxDataPointId;
     };
+
+    // World state of a WorldEval without heap storage, copying it is a
+    // plain memory copy.
+    template<size_t MAX_ENEMIES, size_t MAX_POINTS>
+    struct WorldSnapshot
+    {
+        static bool fits(const World &world)
+        {
+            return world.enemies.size() <= MAX_ENEMIES &&
+                world.dataPoints.size() <= MAX_POINTS;
+        }
+
+        WorldSnapshot()
+        {}
+        explicit WorldSnapshot(const WorldEval &worldEval)
+        {
+            worldEval.save(*this);
+        }
+
+        Player player;
+        size_t enemyCount;
+        size_t pointCount;
+        array<Enemy, MAX_ENEMIES> enemies;
+        // data point ids by enemy index
+        array<int, MAX_ENEMIES> enemyPoints;
+        array<DataPoint, MAX_POINTS> dataPoints;
+        int totalHealth;
+        hashing::Hash enemiesHash;
+        hashing::Hash enemyIdsHash;
+        hashing::Hash dataPointIdsHash;
+    };
+
+    template<size_t MAX_ENEMIES, size_t MAX_POINTS>
+    void WorldEval::save(
+        WorldSnapshot<MAX_ENEMIES, MAX_POINTS> &snapshot) const
+    {
+        assert((WorldSnapshot<MAX_ENEMIES, MAX_POINTS>::fits(world)));
+        snapshot.player = world.player;
+        snapshot.enemyCount = world.enemies.size();
+        snapshot.pointCount = world.dataPoints.size();
+        for(size_t i = 0; i < world.enemies.size(); ++i)
+        {
+            snapshot.enemies[i] = world.enemies[i];
+            snapshot.enemyPoints[i] = enemyPoints[world.enemies[i].id];
+        }
+        copy(world.dataPoints.begin(), world.dataPoints.end(),
+            snapshot.dataPoints.begin());
+        snapshot.totalHealth = totalHealth;
+        snapshot.enemiesHash = enemiesHash;
+        snapshot.enemyIdsHash = enemyIdsHash;
+        snapshot.dataPointIdsHash = dataPointIdsHash;
+    }
+
+    template<size_t MAX_ENEMIES, size_t MAX_POINTS>
+    void WorldEval::restore(
+        const WorldSnapshot<MAX_ENEMIES, MAX_POINTS> &snapshot)
+    {
+        world.player = snapshot.player;
+        world.enemies.assign(snapshot.enemies.begin(),
+            snapshot.enemies.begin() + snapshot.enemyCount);
+        world.dataPoints.assign(snapshot.dataPoints.begin(),
+            snapshot.dataPoints.begin() + snapshot.pointCount);
+        enemyLanes.x.resize(snapshot.enemyCount);
+        enemyLanes.y.resize(snapshot.enemyCount);
+        fill(enemyPoints.begin(), enemyPoints.end(), -1);
+        for(size_t i = 0; i < snapshot.enemyCount; ++i)
+        {
+            const auto &e = snapshot.enemies[i];
+            enemyLanes.x[i] = e.pos.x;
+            enemyLanes.y[i] = e.pos.y;
+            enemyPoints[e.id] = snapshot.enemyPoints[i];
+        }
+        indexEnemies();
+        indexDataPoints();
+        totalHealth = snapshot.totalHealth;
+        enemiesHash = snapshot.enemiesHash;
+        enemyIdsHash = snapshot.enemyIdsHash;
+        dataPointIdsHash = snapshot.dataPointIdsHash;
+    }
 }
 
 #endif
@@ -2,6 +2,7 @@
 #define GEOM_H
 
 #include <cmath>
+#include <cstdint>
 #include <ostream>
 
 namespace geom
@@ -53,6 +54,34 @@ namespace geom
         return sqrt(dx*dx + dy*dy);
     }
 
+    // Squared distances are exact integers and sqrt keeps their order, so
+    // comparing them gives the same results as comparing dist.
+    inline std::int64_t dist2(const Point &left, const Point &right)
+    {
+        const std::int64_t dx = left.x - right.x;
+        const std::int64_t dy = left.y - right.y;
+        return dx*dx + dy*dy;
+    }
+
+    // dist(left, right) <= d
+    inline bool withinDist(const Point &left, const Point &right, int d)
+    {
+        return dist2(left, right) <= static_cast<std::int64_t>(d)*d;
+    }
+
+    // dist(left, right) < d
+    inline bool closerThan(const Point &left, const Point &right, int d)
+    {
+        return dist2(left, right) < static_cast<std::int64_t>(d)*d;
+    }
+
+    // static_cast<int>(dist(left, right)) <= d, the distance is truncated
+    inline bool withinTruncatedDist(const Point &left, const Point &right,
+        int d)
+    {
+        return dist2(left, right) < static_cast<std::int64_t>(d+1)*(d+1);
+    }
+
     inline Vect norm(const Vect &v)
     {
         const auto d = sqrt(v.x*v.x + v.y*v.y);
@@ -0,0 +1,49 @@
+#include "grid.h"
+
+#include <cmath>
+
+namespace geom
+{
+    PointGrid::PointGrid(const EntryCol &points)
+        :entries(), cellBegin(), origin{0, 0}, cellSize(1), cellsX(1),
+        cellsY(1)
+    {
+        if(!points.empty())
+        {
+            Point last = points.front().pos;
+            origin = last;
+            for(const auto &p : points)
+            {
+                origin.x = std::min(origin.x, p.pos.x);
+                origin.y = std::min(origin.y, p.pos.y);
+                last.x = std::max(last.x, p.pos.x);
+                last.y = std::max(last.y, p.pos.y);
+            }
+            // about one point per cell
+            const double width = static_cast<double>(last.x) - origin.x + 1;
+            const double height = static_cast<double>(last.y) - origin.y + 1;
+            cellSize = std::max(1, static_cast<int>(std::ceil(
+                        std::sqrt(width*height/points.size()))));
+            cellsX = static_cast<int>(std::ceil(width/cellSize));
+            cellsY = static_cast<int>(std::ceil(height/cellSize));
+        }
+        const auto cellCount = static_cast<std::size_t>(cellsX)*cellsY;
+        std::vector<std::size_t> cells;
+        cells.reserve(points.size());
+        cellBegin.assign(cellCount+1, 0);
+        for(const auto &p : points)
+        {
+            const auto cell = static_cast<std::size_t>(
+                cellCoord(p.pos.y - origin.y, cellsY))*cellsX +
+                cellCoord(p.pos.x - origin.x, cellsX);
+            cells.push_back(cell);
+            ++cellBegin[cell+1];
+        }
+        for(std::size_t i = 0; i < cellCount; ++i)
+            cellBegin[i+1] += cellBegin[i];
+        entries.resize(points.size());
+        auto next = cellBegin;
+        for(std::size_t i = 0; i < points.size(); ++i)
+            entries[next[cells[i]]++] = points[i];
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "geom.h"
+
+namespace geom
+{
+    // Uniform grid over a fixed set of points with ids. Points are never
+    // removed from the grid, queries skip the ones the caller reports as
+    // removed, so one grid can be shared by every state of a game.
+    class PointGrid
+    {
+    public:
+        struct Entry
+        {
+            int id;
+            Point pos;
+        };
+        using EntryCol = std::vector<Entry>;
+
+        PointGrid(const EntryCol &points);
+
+        // id of the closest point with alive(id), the smaller id on equal
+        // distances, -1 if there is none
+        template<class Alive>
+        int closest(const Point &pos, const Alive &alive) const
+        {
+            const int cx = cellCoord(pos.x - origin.x, cellsX);
+            const int cy = cellCoord(pos.y - origin.y, cellsY);
+            const int maxRing = std::max(
+                std::max(cx, cellsX-1-cx), std::max(cy, cellsY-1-cy));
+            int bestId = -1;
+            std::int64_t bestDist2 = 0;
+            const auto visit = [&](int x, int y) {
+                const auto cell = static_cast<std::size_t>(y)*cellsX + x;
+                for(auto i = cellBegin[cell]; i < cellBegin[cell+1]; ++i)
+                {
+                    const auto &e = entries[i];
+                    if(!alive(e.id))
+                        continue;
+                    const auto d2 = dist2(e.pos, pos);
+                    if(bestId < 0 || d2 < bestDist2 ||
+                        (d2 == bestDist2 && e.id < bestId))
+                    {
+                        bestId = e.id;
+                        bestDist2 = d2;
+                    }
+                }
+            };
+            for(int r = 0; r <= maxRing; ++r)
+            {
+                // points of the ring r are farther than (r-1)*cellSize
+                if(bestId >= 0 && r > 0)
+                {
+                    const std::int64_t bound = static_cast<std::int64_t>(r-1)*cellSize;
+                    if(bestDist2 <= bound*bound)
+                        break;
+                }
+                const int beginY = std::max(cy-r, 0);
+                const int endY = std::min(cy+r, cellsY-1);
+                for(int y = beginY; y <= endY; ++y)
+                {
+                    if(y == cy-r || y == cy+r)
+                    {
+                        const int beginX = std::max(cx-r, 0);
+                        const int endX = std::min(cx+r, cellsX-1);
+                        for(int x = beginX; x <= endX; ++x)
+                            visit(x, y);
+                    }
+                    else
+                    {
+                        if(cx-r >= 0)
+                            visit(cx-r, y);
+                        if(r > 0 && cx+r < cellsX)
+                            visit(cx+r, y);
+                    }
+                }
+            }
+            return bestId;
+        }
+
+    private:
+        // cell of an offset from the origin, outside offsets are clamped
+        int cellCoord(int offset, int cells) const
+        {
+            return std::min(std::max(offset/cellSize, 0), cells-1);
+        }
+
+        // grouped by cell
+        EntryCol entries;
+        std::vector<std::size_t> cellBegin;
+        Point origin;
+        int cellSize;
+        int cellsX;
+        int cellsY;
+    };
+}
+
+#endif
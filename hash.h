@@ -0,0 +1,25 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+
+namespace hashing
+{
+    using Hash = std::uint64_t;
+
+    inline Hash mixHash(Hash v)
+    {
+        v += 0x9e3779b97f4a7c15ULL;
+        v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+        return v ^ (v >> 31);
+    }
+
+    // order dependent: combining (a, b) differs from (b, a)
+    inline Hash combineHash(Hash seed, Hash v)
+    {
+        return mixHash(((seed << 23) | (seed >> 41)) ^ mixHash(v));
+    }
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cassert>
+
+namespace heap
+{
+    using namespace std;
+
+    // Priority queue in a vector where every item has up to ARITY children.
+    // A wider node takes fewer levels to sift through and its children
+    // share cache lines. The top is the greatest item by Less, as in
+    // std::priority_queue.
+    template<class T, size_t ARITY = 4, class Less = less<T>>
+    class DaryHeap
+    {
+    public:
+        static_assert(ARITY >= 2, "heap arity is at least two");
+
+        DaryHeap(const Less &lessItem = Less())
+            :items(), lessItem(lessItem)
+        {}
+
+        bool empty() const
+        {
+            return items.empty();
+        }
+
+        size_t size() const
+        {
+            return items.size();
+        }
+
+        const T &top() const
+        {
+            assert(!items.empty());
+            return items.front();
+        }
+
+        void push(T item)
+        {
+            items.push_back(move(item));
+            siftUp(items.size()-1);
+        }
+
+        void pop()
+        {
+            assert(!items.empty());
+            items.front() = move(items.back());
+            items.pop_back();
+            if(!items.empty())
+                siftDown(0);
+        }
+
+        void clear()
+        {
+            items.clear();
+        }
+
+        // in no particular order
+        const vector<T> &elements() const
+        {
+            return items;
+        }
+
+        // replaces the contents, heapifies in linear time
+        void assign(vector<T> newItems)
+        {
+            items = move(newItems);
+            for(size_t i = items.size()/ARITY+1; i > 0; --i)
+                siftDown(i-1);
+        }
+
+    private:
+        void siftUp(size_t idx)
+        {
+            T item = move(items[idx]);
+            while(idx > 0)
+            {
+                const auto parent = (idx-1)/ARITY;
+                if(!lessItem(items[parent], item))
+                    break;
+                items[idx] = move(items[parent]);
+                idx = parent;
+            }
+            items[idx] = move(item);
+        }
+
+        void siftDown(size_t idx)
+        {
+            if(idx >= items.size())
+                return;
+            T item = move(items[idx]);
+            while(true)
+            {
+                const auto first = idx*ARITY+1;
+                if(first >= items.size())
+                    break;
+                const auto last = min(first+ARITY, items.size());
+                auto greatest = first;
+                for(auto c = first+1; c < last; ++c)
+                {
+                    if(lessItem(items[greatest], items[c]))
+                        greatest = c;
+                }
+                if(!lessItem(item, items[greatest]))
+                    break;
+                items[idx] = move(items[greatest]);
+                idx = greatest;
+            }
+            items[idx] = move(item);
+        }
+
+        vector<T> items;
+        Less lessItem;
+    };
+}
+
+#endif
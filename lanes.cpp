@@ -0,0 +1,244 @@
+#include "lanes.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LANES_X86
+#include <immintrin.h>
+#endif
+
+namespace game
+{
+    namespace lanes
+    {
+        namespace
+        {
+            // the squared distance is exact in double, so comparing it
+            // matches comparing geom::dist
+            bool anyWithinScalar(const int *x, const int *y, size_t begin,
+                size_t count, const geom::Point &p, double maxDist2)
+            {
+                for(size_t i = begin; i < count; ++i)
+                {
+                    const double dx = x[i] - p.x;
+                    const double dy = y[i] - p.y;
+                    if(dx*dx + dy*dy <= maxDist2)
+                        return true;
+                }
+                return false;
+            }
+
+            void moveTowardsScalar(int *x, int *y, const int *targetX,
+                const int *targetY, size_t begin, size_t count, int stepDist,
+                unsigned char *reached)
+            {
+                for(size_t i = begin; i < count; ++i)
+                {
+                    const geom::Point pos{x[i], y[i]};
+                    const geom::Point target{targetX[i], targetY[i]};
+                    if(geom::withinTruncatedDist(target, pos, stepDist))
+                    {
+                        x[i] = target.x;
+                        y[i] = target.y;
+                        reached[i] = 1;
+                    }
+                    else
+                    {
+                        const auto next = geom::add(pos, geom::mult(
+                                geom::normDirection(pos, target), stepDist));
+                        x[i] = next.x;
+                        y[i] = next.y;
+                        reached[i] = 0;
+                    }
+                }
+            }
+
+#ifdef LANES_X86
+            bool hasAvx2()
+            {
+                static const bool res = []() {
+                    __builtin_cpu_init();
+                    return __builtin_cpu_supports("avx2") != 0;
+                }();
+                return res;
+            }
+
+            __attribute__((target("avx2")))
+            bool anyWithinAvx2(const int *x, const int *y, size_t count,
+                const geom::Point &p, double maxDist2)
+            {
+                const auto px = _mm_set1_epi32(p.x);
+                const auto py = _mm_set1_epi32(p.y);
+                const auto limit = _mm256_set1_pd(maxDist2);
+                size_t i = 0;
+                for(; i+4 <= count; i += 4)
+                {
+                    const auto dx = _mm256_cvtepi32_pd(_mm_sub_epi32(
+                            _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(x+i)), px));
+                    const auto dy = _mm256_cvtepi32_pd(_mm_sub_epi32(
+                            _mm_loadu_si128(
+                                reinterpret_cast<const __m128i*>(y+i)), py));
+                    const auto d2 = _mm256_add_pd(_mm256_mul_pd(dx, dx),
+                        _mm256_mul_pd(dy, dy));
+                    if(_mm256_movemask_pd(_mm256_cmp_pd(d2, limit, _CMP_LE_OQ)))
+                        return true;
+                }
+                return anyWithinScalar(x, y, i, count, p, maxDist2);
+            }
+
+            // the operations follow geom::dist, normDirection, mult and add
+            // one by one, FMA isn't enabled so nothing gets fused
+            __attribute__((target("avx2")))
+            void moveTowardsAvx2(int *x, int *y, const int *targetX,
+                const int *targetY, size_t count, int stepDist,
+                unsigned char *reached)
+            {
+                const auto step = _mm256_set1_pd(stepDist);
+                const auto stepBound = _mm_set1_epi32(stepDist+1);
+                size_t i = 0;
+                for(; i+4 <= count; i += 4)
+                {
+                    const auto xi = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(x+i));
+                    const auto yi = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(y+i));
+                    const auto txi = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(targetX+i));
+                    const auto tyi = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(targetY+i));
+                    const auto dx = _mm256_cvtepi32_pd(_mm_sub_epi32(txi, xi));
+                    const auto dy = _mm256_cvtepi32_pd(_mm_sub_epi32(tyi, yi));
+                    const auto d = _mm256_sqrt_pd(_mm256_add_pd(
+                            _mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+                    const auto isReached = _mm_cmpgt_epi32(stepBound,
+                        _mm256_cvttpd_epi32(d));
+                    // reached lanes may divide by zero, they are replaced
+                    const auto nextX = _mm256_cvttpd_epi32(_mm256_add_pd(
+                            _mm256_cvtepi32_pd(xi),
+                            _mm256_mul_pd(_mm256_div_pd(dx, d), step)));
+                    const auto nextY = _mm256_cvttpd_epi32(_mm256_add_pd(
+                            _mm256_cvtepi32_pd(yi),
+                            _mm256_mul_pd(_mm256_div_pd(dy, d), step)));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(x+i),
+                        _mm_blendv_epi8(nextX, txi, isReached));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(y+i),
+                        _mm_blendv_epi8(nextY, tyi, isReached));
+                    const auto mask = _mm_movemask_ps(_mm_castsi128_ps(isReached));
+                    for(size_t j = 0; j < 4; ++j)
+                        reached[i+j] = (mask >> j) & 1;
+                }
+                moveTowardsScalar(x, y, targetX, targetY, i, count, stepDist,
+                    reached);
+            }
+#endif
+
+#ifdef __SSE2__
+            __m128i loadPair(const int *p)
+            {
+                return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+            }
+
+            void storePair(int *p, __m128i v)
+            {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(p), v);
+            }
+
+            __m128i select(__m128i mask, __m128i ifSet, __m128i ifUnset)
+            {
+                return _mm_or_si128(_mm_and_si128(mask, ifSet),
+                    _mm_andnot_si128(mask, ifUnset));
+            }
+
+            bool anyWithinSse2(const int *x, const int *y, size_t count,
+                const geom::Point &p, double maxDist2)
+            {
+                const auto px = _mm_set1_epi32(p.x);
+                const auto py = _mm_set1_epi32(p.y);
+                const auto limit = _mm_set1_pd(maxDist2);
+                size_t i = 0;
+                for(; i+2 <= count; i += 2)
+                {
+                    const auto dx = _mm_cvtepi32_pd(
+                        _mm_sub_epi32(loadPair(x+i), px));
+                    const auto dy = _mm_cvtepi32_pd(
+                        _mm_sub_epi32(loadPair(y+i), py));
+                    const auto d2 = _mm_add_pd(_mm_mul_pd(dx, dx),
+                        _mm_mul_pd(dy, dy));
+                    if(_mm_movemask_pd(_mm_cmple_pd(d2, limit)))
+                        return true;
+                }
+                return anyWithinScalar(x, y, i, count, p, maxDist2);
+            }
+
+            void moveTowardsSse2(int *x, int *y, const int *targetX,
+                const int *targetY, size_t count, int stepDist,
+                unsigned char *reached)
+            {
+                const auto step = _mm_set1_pd(stepDist);
+                const auto stepBound = _mm_set1_epi32(stepDist+1);
+                size_t i = 0;
+                for(; i+2 <= count; i += 2)
+                {
+                    const auto xi = loadPair(x+i);
+                    const auto yi = loadPair(y+i);
+                    const auto txi = loadPair(targetX+i);
+                    const auto tyi = loadPair(targetY+i);
+                    const auto dx = _mm_cvtepi32_pd(_mm_sub_epi32(txi, xi));
+                    const auto dy = _mm_cvtepi32_pd(_mm_sub_epi32(tyi, yi));
+                    const auto d = _mm_sqrt_pd(_mm_add_pd(
+                            _mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+                    const auto isReached = _mm_cmpgt_epi32(stepBound,
+                        _mm_cvttpd_epi32(d));
+                    const auto nextX = _mm_cvttpd_epi32(_mm_add_pd(
+                            _mm_cvtepi32_pd(xi),
+                            _mm_mul_pd(_mm_div_pd(dx, d), step)));
+                    const auto nextY = _mm_cvttpd_epi32(_mm_add_pd(
+                            _mm_cvtepi32_pd(yi),
+                            _mm_mul_pd(_mm_div_pd(dy, d), step)));
+                    storePair(x+i, select(isReached, txi, nextX));
+                    storePair(y+i, select(isReached, tyi, nextY));
+                    const auto mask = _mm_movemask_ps(_mm_castsi128_ps(isReached));
+                    reached[i] = mask & 1;
+                    reached[i+1] = (mask >> 1) & 1;
+                }
+                moveTowardsScalar(x, y, targetX, targetY, i, count, stepDist,
+                    reached);
+            }
+#endif
+        }
+
+        bool anyWithin(const int *x, const int *y, size_t count,
+            const geom::Point &p, int maxDist)
+        {
+            const double maxDist2 = static_cast<double>(maxDist)*maxDist;
+#ifdef LANES_X86
+            if(hasAvx2())
+                return anyWithinAvx2(x, y, count, p, maxDist2);
+#endif
+#ifdef __SSE2__
+            return anyWithinSse2(x, y, count, p, maxDist2);
+#else
+            return anyWithinScalar(x, y, 0, count, p, maxDist2);
+#endif
+        }
+
+        void moveTowards(int *x, int *y, const int *targetX,
+            const int *targetY, size_t count, int stepDist,
+            unsigned char *reached)
+        {
+#ifdef LANES_X86
+            if(hasAvx2())
+            {
+                moveTowardsAvx2(x, y, targetX, targetY, count, stepDist,
+                    reached);
+                return;
+            }
+#endif
+#ifdef __SSE2__
+            moveTowardsSse2(x, y, targetX, targetY, count, stepDist, reached);
+#else
+            moveTowardsScalar(x, y, targetX, targetY, 0, count, stepDist,
+                reached);
+#endif
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include <cstddef>
+#include <vector>
+
+#include "geom.h"
+
+namespace game
+{
+    using namespace std;
+
+    // Enemy positions by enemy index in structure of arrays layout, the
+    // vector kernels load several enemies at once from it.
+    struct EnemyLanes
+    {
+        vector<int> x;
+        vector<int> y;
+    };
+
+    // Kernels over coordinate arrays. They pick AVX2 or SSE2 at runtime
+    // and fall back to scalar code, every variant gives the same results
+    // as the geom functions.
+    namespace lanes
+    {
+        // true if any point is within maxDist of p, the bound is inclusive
+        bool anyWithin(const int *x, const int *y, size_t count,
+            const geom::Point &p, int maxDist);
+
+        // moves every point stepDist towards its target, a point that is
+        // less than stepDist+1 away is put on the target and marked in
+        // reached
+        void moveTowards(int *x, int *y, const int *targetX,
+            const int *targetY, size_t count, int stepDist,
+            unsigned char *reached);
+    }
+}
+
+#endif
@@ -11,17 +11,73 @@ namespace logic
     namespace
     {
         using VectCol = vector<geom::Vect>;
+
+        template<class Producer>
+        optimizer::CmdCol collectCmds(const Producer &producer,
+            const game::WorldEval &worldEval, const game::Analysis &analysis)
+        {
+            optimizer::CmdBuffer buffer;
+            producer(worldEval, analysis, buffer);
+            return optimizer::CmdCol(buffer.begin(), buffer.end());
+        }
     }
 
-    Logic::Logic()
-        :optimizer(searchFuncs)
+    Logic::Logic(EngineKind engineKind, bool pondering,
+        const TimeConfig &timeConfig, size_t threads)
+        :timeManager(timeConfig),
+        optimizer(makeEngine(engineKind, timeConfig, threads)),
+        pondering(pondering)
     {}
 
+    unique_ptr<optimizer::Engine> Logic::makeEngine(EngineKind engineKind,
+        const TimeConfig &timeConfig, size_t threads)
+    {
+        switch(engineKind)
+        {
+        case EngineKind::BEAM:
+            return unique_ptr<optimizer::Engine>(
+                new optimizer::BeamOptimizer(searchProducer));
+        case EngineKind::MCTS:
+            return unique_ptr<optimizer::Engine>(
+                new optimizer::MctsOptimizer(searchProducer));
+        case EngineKind::BEST_FIRST:
+        {
+            optimizer::OptimizerConfig config;
+            config.order = optimizer::SearchOrder::BEST_FIRST;
+            config.threads = threads;
+            return unique_ptr<optimizer::Engine>(
+                new optimizer::Optimizer(searchProducer, config));
+        }
+        case EngineKind::TREE:
+        default:
+        {
+            optimizer::OptimizerConfig config;
+            config.stableLevels = timeConfig.stableLevels;
+            config.threads = threads;
+            return unique_ptr<optimizer::Engine>(
+                new optimizer::Optimizer(searchProducer, config));
+        }
+        }
+    }
+
+    void Logic::startTurn()
+    {
+        timeManager.startTurn();
+    }
+
+    void Logic::endTurn()
+    {
+        timeManager.endTurn();
+        if(pondering)
+            optimizer->ponder();
+    }
+
     game::Cmd Logic::step(const game::World &world)
     {
         cerr<<"trying optimized step"<<endl;
-        const auto optRes = optimizer.optimize(world,
-            chrono::duration_cast<chrono::milliseconds>(game::TIME_LIMIT*0.95));
+        const auto optRes = optimizer->optimize(world,
+            timeManager.beginSearch());
+        timeManager.endSearch();
         if(optRes.second)
         {
             return optRes.first;
@@ -30,31 +86,6 @@ namespace logic
         return game::Cmd::makeMoveCmd(world.player.pos, "give up");
     }
 
-    game::PointCol Logic::calcEnemyClosestPoints(const game::World &w)
-    {
-        const auto &enemies = w.enemies;
-        const auto &points = w.dataPoints;
-        game::PointCol res;
-        for(size_t i = 0; i < enemies.size(); ++i)
-        {
-            const auto &e = enemies[i];
-            size_t minIdx = 0;
-            double minDist = numeric_limits<double>::max();
-            for(size_t j = 0; j < points.size(); ++j)
-            {
-                const auto &p = points[j];
-                const auto pointDist = geom::dist(p.pos, e.pos);
-                if(pointDist < minDist)
-                {
-                    minIdx = j;
-                    minDist = pointDist;
-                }
-            }
-            res.push_back(points[minIdx].pos);
-        }
-        return res;
-    }
-
     IdxCol Logic::enemiesIndicesByDistance(const game::World &w, size_t count)
     {
         IdxCol res;
@@ -64,73 +95,14 @@ namespace logic
         const auto middle = min(count, res.size());
         partial_sort(res.begin(), res.begin()+middle, res.end(),
             [&w](const size_t left, const size_t right) {
-            const auto leftDist = geom::dist(w.player.pos, w.enemies[left].pos);
-            const auto rightDist = geom::dist(w.player.pos, w.enemies[right].pos);
+            const auto leftDist = geom::dist2(w.player.pos, w.enemies[left].pos);
+            const auto rightDist = geom::dist2(w.player.pos, w.enemies[right].pos);
             return leftDist < rightDist;
             });
         res.resize(middle);
         return res;
     }
 
-    size_t Logic::selectPointEnemy(const game::WorldEval &w)
-    {
-        const auto &enemies = w.getWorld().enemies;
-        assert(!enemies.empty());
-        double pointEnemyMinDist = numeric_limits<double>::max();
-        int pointClosestEnemyIdx = 0;
-        for(size_t i = 0; i < enemies.size(); ++i)
-        {
-            const auto &e = enemies[i];
-            const auto ep = w.getEnemyPoint(e.id);
-            if(ep.second)
-            {
-                const auto d = geom::dist(e.pos, ep.first.pos);
-                if(d < pointEnemyMinDist)
-                {
-                    pointEnemyMinDist = d;
-                    pointClosestEnemyIdx = i;
-                }
-            }
-        }
-        return pointClosestEnemyIdx;
-    }
-
-    size_t Logic::selectClosestEnemy(const game::World &w)
-    {
-        const auto &player = w.player;
-        auto iter = min_element(w.enemies.begin(), w.enemies.end(),
-            [&player](const game::EnemyCol::value_type &left, const game::EnemyCol::value_type &right) {
-            return geom::dist(player.pos, left.pos) < geom::dist(player.pos, right.pos);
-            });
-        assert(iter != w.enemies.end());
-        return iter - w.enemies.begin();
-    }
-
-    // TODO: don't move too close to enemies
-    geom::Point Logic::selectPosition(const game::World &w)
-    {
-        const auto &enemies = w.enemies;
-        if(!enemies.empty())
-        {
-            long long int avgX = 0;
-            long long int avgY = 0;
-            for(const auto &p : enemies)
-            {
-                avgX += p.pos.x;
-                avgY += p.pos.y;
-            }
-            avgX /= enemies.size();
-            avgY /= enemies.size();
-            const geom::Point target{static_cast<int>(avgX),
-                static_cast<int>(avgY)};
-            return target;
-        }
-        else
-        {
-            return w.player.pos;
-        }
-    }
-
     geom::Point Logic::averageDataPointPosition(const game::World &w)
     {
         const auto &points = w.dataPoints;
@@ -147,17 +119,18 @@ namespace logic
         return geom::Point{static_cast<int>(avgX), static_cast<int>(avgY)};
     }
 
-    pair<geom::Point, bool> Logic::selectRunPosition(const game::World &w)
+    pair<geom::Point, bool> Logic::selectRunPosition(const game::World &w,
+        const game::Analysis &analysis)
     {
         const auto &enemies = w.enemies;
         const auto &player = w.player;
+        const int64_t runDist = game::DEATH_DIST+game::DEATH_DIST;
         game::PointCol deathPoints;
-        for(const auto &p : enemies)
+        for(size_t i = 0; i < enemies.size(); ++i)
         {
-            // TODO: proper equality comparison for floating point
-            if(geom::dist(p.pos, player.pos) < game::DEATH_DIST+game::DEATH_DIST)
+            if(analysis.playerDist2[i] < runDist*runDist)
             {
-                deathPoints.push_back(p.pos);
+                deathPoints.push_back(enemies[i].pos);
             }
         }
         if(!deathPoints.empty())
@@ -223,73 +196,82 @@ namespace logic
         return make_pair(geom::Point{0, 0}, false);
     }
 
-    geom::Point Logic::nextEnemyPosition(const game::Enemy &enemy, const geom::Point &point)
+    void Logic::EnemyProducer::operator()(const game::WorldEval &worldEval,
+        const game::Analysis &analysis, optimizer::CmdBuffer &out) const
     {
-        return geom::add(enemy.pos,
-            geom::mult(geom::normDirection(enemy.pos,
-                    point), game::ENEMY_STEP_DIST));
-    }
-
-    const optimizer::CmdFuncCol Logic::searchFuncs{
-        [](const game::WorldEval &worldEval) {
-            const auto &world = worldEval.getWorld();
-            CmdCol res;
-            if(!world.enemies.empty())
+        const auto &world = worldEval.getWorld();
+        if(!world.enemies.empty())
+        {
+            const auto closestEnemyIdx = analysis.closestEnemyIdx;
+            assert(closestEnemyIdx < world.enemies.size());
+            const auto pointEnemyIdx = analysis.pointEnemyIdx;
+            assert(pointEnemyIdx < world.enemies.size());
+            const auto &pointEnemy = world.enemies[pointEnemyIdx];
+            const auto &closestEnemy = world.enemies[closestEnemyIdx];
+            out.push_back(game::Cmd::makeShootCmd(pointEnemy.id,
+                    "shooting point enemy"));
+            double step = game::PLAYER_STEP_DIST;
+            const auto closestEnemyDist = geom::dist(
+                world.player.pos, analysis.nextPositions[closestEnemyIdx]);
+            if(step + game::DEATH_DIST >= closestEnemyDist)
+                step = closestEnemyDist - game::DEATH_DIST - 5.0;
+            out.push_back(game::Cmd::makeMoveCmd(
+                    geom::add(world.player.pos,
+                        geom::mult(
+                            geom::normDirection(world.player.pos,
+                                analysis.nextPositions[pointEnemyIdx]),
+                            step)),
+                    "moving to point enemy"));
+            //                  out.push_back(Cmd::makeMoveCmd(enemyPoints[closestEnemyIdx],
+            //                          "moving to closest enemy destination"));
+            if(pointEnemyIdx != closestEnemyIdx)
             {
-                const auto enemyPoints = calcEnemyClosestPoints(world);
-                const auto closestEnemyIdx = selectClosestEnemy(world);
-                assert(closestEnemyIdx < world.enemies.size());
-                const auto pointEnemyIdx = selectPointEnemy(worldEval);
-                assert(pointEnemyIdx < world.enemies.size());
-                const auto &pointEnemy = world.enemies[pointEnemyIdx];
-                const auto &closestEnemy = world.enemies[closestEnemyIdx];
-                res.push_back(game::Cmd::makeShootCmd(pointEnemy.id,
-                        "shooting point enemy"));
-                double step = game::PLAYER_STEP_DIST;
-                const auto closestEnemyDist = geom::dist(
-                    world.player.pos, nextEnemyPosition(closestEnemy,
-                        enemyPoints[closestEnemyIdx]));
-                if(step + game::DEATH_DIST >= closestEnemyDist)
-                    step = closestEnemyDist - game::DEATH_DIST - 5.0;
-                res.push_back(game::Cmd::makeMoveCmd(
+                out.push_back(game::Cmd::makeShootCmd(closestEnemy.id,
+                        "shooting closest enemy"));
+                out.push_back(game::Cmd::makeMoveCmd(
                         geom::add(world.player.pos,
                             geom::mult(
                                 geom::normDirection(world.player.pos,
-                                    nextEnemyPosition(pointEnemy,
-                                        enemyPoints[pointEnemyIdx])),
+                                    analysis.nextPositions[closestEnemyIdx]),
                                 step)),
-                        "moving to point enemy"));
-                //                  res.push_back(Cmd::makeMoveCmd(enemyPoints[closestEnemyIdx],
-                //                          "moving to closest enemy destination"));
-                if(pointEnemyIdx != closestEnemyIdx)
-                {
-                    res.push_back(game::Cmd::makeShootCmd(closestEnemy.id,
-                            "shooting closest enemy"));
-                    res.push_back(game::Cmd::makeMoveCmd(
-                            geom::add(world.player.pos,
-                                geom::mult(
-                                    geom::normDirection(world.player.pos,
-                                        nextEnemyPosition(closestEnemy,
-                                            enemyPoints[closestEnemyIdx])),
-                                    step)),
-                            "moving to closest enemy"));
-                }
+                        "moving to closest enemy"));
             }
-            return res;
+        }
+    }
+
+    // TODO: don't move too close to enemies
+    void Logic::CentroidProducer::operator()(const game::WorldEval&,
+        const game::Analysis &analysis, optimizer::CmdBuffer &out) const
+    {
+        out.push_back(game::Cmd::makeMoveCmd(analysis.enemiesCentroid,
+                "moving to enemies centroid"));
+    }
+
+    void Logic::RunProducer::operator()(const game::WorldEval &worldEval,
+        const game::Analysis &analysis, optimizer::CmdBuffer &out) const
+    {
+        const auto runPosRes = selectRunPosition(worldEval.getWorld(),
+            analysis);
+        if(runPosRes.second)
+        {
+            out.push_back(game::Cmd::makeMoveCmd(runPosRes.first,
+                    "running from enemies"));
+        }
+    }
+
+    const optimizer::CmdProducer Logic::searchProducer(
+        optimizer::makeCmdPipeline(EnemyProducer(), CentroidProducer(),
+            RunProducer()));
+
+    const optimizer::CmdFuncCol Logic::searchFuncs{
+        [](const game::WorldEval &worldEval, const game::Analysis &analysis) {
+            return collectCmds(EnemyProducer(), worldEval, analysis);
         },
-        [](const game::WorldEval &worldEval) {
-            const auto moveCmd = game::Cmd::makeMoveCmd(selectPosition(worldEval.getWorld()),
-                "moving to enemies centroid");
-            return CmdCol{moveCmd};
+        [](const game::WorldEval &worldEval, const game::Analysis &analysis) {
+            return collectCmds(CentroidProducer(), worldEval, analysis);
         },
-        [](const game::WorldEval &worldEval) {
-            const auto runPosRes = selectRunPosition(worldEval.getWorld());
-            if(runPosRes.second)
-            {
-                return CmdCol{game::Cmd::makeMoveCmd(runPosRes.first,
-                    "running from enemies")};
-            }
-            return Logic::CmdCol();
+        [](const game::WorldEval &worldEval, const game::Analysis &analysis) {
+            return collectCmds(RunProducer(), worldEval, analysis);
         }
     };
 }
@@ -3,10 +3,15 @@
 
 #include <vector>
 #include <functional>
+#include <memory>
 
 #include "game.h"
+#include "analysis.h"
 #include "geom.h"
 #include "optimizer.h"
+#include "beam.h"
+#include "mcts.h"
+#include "timemanager.h"
 
 namespace logic
 {
@@ -14,29 +19,66 @@ namespace logic
 
     using IdxCol = vector<size_t>;
 
+    enum class EngineKind
+    {
+        TREE,
+        BEAM,
+        MCTS,
+        // the tree optimizer in best first order
+        BEST_FIRST
+    };
+
     class Logic
     {
     public:
-        Logic();
+        // pondering searches in the background between the turns, it
+        // starts when the output is written; threads expand the levels of
+        // the tree engine in parallel
+        Logic(EngineKind engineKind = EngineKind::TREE, bool pondering = false,
+            const TimeConfig &timeConfig = TimeConfig(), size_t threads = 1);
 
+        // the input of the turn begins, without it the turn starts in step
+        void startTurn();
         game::Cmd step(const game::World &world);
+        // the output of the turn is written, starts pondering
+        void endTurn();
 
+        // the producers of the search moves in one pipeline
+        static const optimizer::CmdProducer searchProducer;
+        // the same producers called one by one, for experiments
         static const optimizer::CmdFuncCol searchFuncs;
 
     private:
-        using CmdCol = vector<game::Cmd>;
+        struct EnemyProducer
+        {
+            void operator()(const game::WorldEval &worldEval,
+                const game::Analysis &analysis,
+                optimizer::CmdBuffer &out) const;
+        };
+        struct CentroidProducer
+        {
+            void operator()(const game::WorldEval &worldEval,
+                const game::Analysis &analysis,
+                optimizer::CmdBuffer &out) const;
+        };
+        struct RunProducer
+        {
+            void operator()(const game::WorldEval &worldEval,
+                const game::Analysis &analysis,
+                optimizer::CmdBuffer &out) const;
+        };
 
-        static game::PointCol calcEnemyClosestPoints(const game::World &w);
         static IdxCol enemiesIndicesByDistance(const game::World &w, size_t count);
-        static size_t selectPointEnemy(const game::WorldEval &w);
-        static size_t selectClosestEnemy(const game::World &w);
-        // TODO: don't move too close to enemies
-        static geom::Point selectPosition(const game::World &w);
         static geom::Point averageDataPointPosition(const game::World &w);
-        static pair<geom::Point, bool> selectRunPosition(const game::World &w);
-        static geom::Point nextEnemyPosition(const game::Enemy &enemy, const geom::Point &point);
+        static pair<geom::Point, bool> selectRunPosition(const game::World &w,
+            const game::Analysis &analysis);
+
+        static unique_ptr<optimizer::Engine> makeEngine(EngineKind engineKind,
+            const TimeConfig &timeConfig, size_t threads);
 
-        optimizer::Optimizer optimizer;
+        TimeManager timeManager;
+        unique_ptr<optimizer::Engine> optimizer;
+        bool pondering;
     };
 }
 
@@ -36,11 +36,17 @@ namespace
 
 int main()
 {
-    logic::Logic logic;
+    logic::TimeConfig timeConfig;
+    timeConfig.firstTurnLimit = game::FIRST_TIME_LIMIT;
+    timeConfig.stableLevels = 4;
+    // no pondering, its search is bounded only by the tree budget
+    logic::Logic logic(logic::EngineKind::TREE, false, timeConfig);
     while(1)
     {
         game::World world{game::Player{geom::Point{0,0}}, game::DataPointCol(), game::EnemyCol()};
         cin>>world.player.pos.x>>world.player.pos.y; cin.ignore();
+        // the referee clock runs from here
+        logic.startTurn();
         int dataCount = 0;
         cin >> dataCount; cin.ignore();
         world.dataPoints.reserve(dataCount);
@@ -79,6 +85,7 @@ int main()
         default:
             assert(false);
         }
+        logic.endTurn();
     }
     return 0;
 }
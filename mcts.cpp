@@ -0,0 +1,256 @@
+#include "mcts.h"
+
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <cassert>
+
+namespace optimizer
+{
+    constexpr MctsOptimizer::NodeIdx MctsOptimizer::NO_NODE;
+
+    MctsOptimizer::MctsOptimizer(const CmdProducer &cmdProducer,
+        const MctsConfig &config)
+        :cmdProducer(cmdProducer), analysis(), producedCmds(), validCmds(),
+        exploration(config.exploration), rolloutDepth(config.rolloutDepth),
+        random(config.seed),
+        nodes(), spareNodes(), remap(),
+        root(NO_NODE), nextRoot(NO_NODE),
+        reference(), best(), bestFound(false)
+    {}
+
+    pair<game::Cmd, bool> MctsOptimizer::optimize(const game::World &world,
+        chrono::milliseconds timeLimit)
+    {
+        const auto beginTime = Clock::now();
+        if(root == NO_NODE || nextRoot == NO_NODE)
+        {
+            reset(world);
+        }
+        else if(nodes[nextRoot].world.getWorld() != world)
+        {
+            cerr<<"predicted world mismatch, reseting search tree"<<endl;
+            reset(world);
+        }
+        else
+        {
+            arena::compactTree(nodes, spareNodes, nextRoot, remap);
+            root = 0;
+        }
+        size_t iterations = 0;
+        // a finished game or a state without commands has nothing to search
+        const bool searchable = !isTerminal(nodes[root]) &&
+            (!nodes[root].untried.empty() || nodes[root].firstChild != NO_NODE);
+        while(searchable && Clock::now() - beginTime < timeLimit)
+        {
+            auto leaf = select(root);
+            if(!isTerminal(nodes[leaf]))
+                leaf = expand(leaf);
+            const auto &leafNode = nodes[leaf];
+            const auto value = (isTerminal(leafNode)
+                ?reward(leafNode.world, leafNode.alive)
+                :rollout(leafNode));
+            backpropagate(leaf, value);
+            ++iterations;
+        }
+        nextRoot = mostVisitedChild(root);
+        bestFound = false;
+        auto cur = nextRoot;
+        while(cur != NO_NODE)
+        {
+            const auto &n = nodes[cur];
+            best = makeCriteria(n.world, n.state);
+            bestFound = true;
+            cur = mostVisitedChild(cur);
+        }
+        cerr<<"mcts stats: time="
+            <<chrono::duration_cast<chrono::milliseconds>(Clock::now()-beginTime).count()
+            <<" iterations="<<iterations
+            <<" nodes="<<nodes.size()
+            <<" root visits="<<nodes[root].visits
+            <<endl;
+        if(nextRoot != NO_NODE)
+        {
+            if(bestFound)
+                cerr<<"optimized result: "<<best<<endl;
+            return make_pair(nodes[nextRoot].cmd, true);
+        }
+        nextRoot = NO_NODE;
+        cerr<<"no optimized result"<<endl;
+        return make_pair(game::Cmd::makeMoveCmd(world.player.pos), false);
+    }
+
+    pair<Criteria, bool> MctsOptimizer::bestCriteria() const
+    {
+        if(bestFound)
+            return make_pair(best, true);
+        return make_pair(Criteria{}, false);
+    }
+
+    void MctsOptimizer::reset(const game::World &world)
+    {
+        nodes.clear();
+        const game::WorldEval worldEval(world);
+        reference = Reference{
+            world.dataPoints.size(),
+            world.enemies.size(),
+            worldEval.getTotalHealth()
+        };
+        root = addNode(game::Cmd::makeMoveCmd(world.player.pos), worldEval,
+            SearchState{0, 0}, true, NO_NODE);
+        nextRoot = root;
+    }
+
+    MctsOptimizer::NodeIdx MctsOptimizer::addNode(const game::Cmd &cmd,
+        const game::WorldEval &world, const SearchState &state, bool alive,
+        NodeIdx parent)
+    {
+        const auto idx = nodes.emplace(Node{cmd, world, state, alive,
+            CmdCol(), 0, 0.0, parent, NO_NODE, NO_NODE, NO_NODE});
+        auto &node = nodes[idx];
+        if(!isTerminal(node))
+        {
+            const auto &cmds = produceCmds(node.world);
+            node.untried.assign(cmds.begin(), cmds.end());
+        }
+        if(parent != NO_NODE)
+            arena::appendChild(nodes, parent, idx);
+        return idx;
+    }
+
+    const CmdBuffer &MctsOptimizer::produceCmds(const game::WorldEval &world)
+    {
+        analysis.update(world);
+        producedCmds.clear();
+        cmdProducer(world, analysis, producedCmds);
+        validCmds.clear();
+        for(const auto &c : producedCmds)
+        {
+            if(c.getType() == game::Cmd::TYPE_MOVE &&
+                !game::insideZone(c.getMovePoint()))
+            {
+                continue;
+            }
+            validCmds.push_back(c);
+        }
+        return validCmds;
+    }
+
+    bool MctsOptimizer::isTerminal(const Node &node) const
+    {
+        const auto &w = node.world.getWorld();
+        return !node.alive || w.enemies.empty() || w.dataPoints.empty();
+    }
+
+    MctsOptimizer::NodeIdx MctsOptimizer::select(NodeIdx idx) const
+    {
+        while(true)
+        {
+            const auto &node = nodes[idx];
+            if(isTerminal(node) || !node.untried.empty() ||
+                node.firstChild == NO_NODE)
+            {
+                return idx;
+            }
+            const auto logVisits = log(static_cast<double>(node.visits));
+            auto bestChild = NO_NODE;
+            double bestValue = -numeric_limits<double>::max();
+            for(auto c = node.firstChild; c != NO_NODE; c = nodes[c].nextSibling)
+            {
+                const auto &child = nodes[c];
+                assert(child.visits > 0);
+                const auto value = child.value/child.visits +
+                    exploration*sqrt(logVisits/child.visits);
+                if(value > bestValue)
+                {
+                    bestValue = value;
+                    bestChild = c;
+                }
+            }
+            idx = bestChild;
+        }
+    }
+
+    MctsOptimizer::NodeIdx MctsOptimizer::expand(NodeIdx idx)
+    {
+        auto &node = nodes[idx];
+        if(node.untried.empty())
+            return idx;
+        uniform_int_distribution<size_t> dist(0, node.untried.size()-1);
+        const auto pos = dist(random);
+        const auto cmd = node.untried[pos];
+        swap(node.untried[pos], node.untried.back());
+        node.untried.pop_back();
+        game::WorldEval world(node.world);
+        auto state = node.state;
+        const auto totalHealthBefore = world.getTotalHealth();
+        const auto alive = world.eval(cmd);
+        if(cmd.getType() == game::Cmd::TYPE_SHOOT)
+        {
+            state.totalDamage += totalHealthBefore - world.getTotalHealth();
+            state.shotsFired += 1;
+        }
+        return addNode(cmd, world, state, alive, idx);
+    }
+
+    double MctsOptimizer::rollout(const Node &node)
+    {
+        game::WorldEval world(node.world);
+        for(size_t i = 0; i < rolloutDepth; ++i)
+        {
+            const auto &w = world.getWorld();
+            if(w.enemies.empty() || w.dataPoints.empty())
+                break;
+            const auto &cmds = produceCmds(world);
+            if(cmds.empty())
+                break;
+            uniform_int_distribution<size_t> dist(0, cmds.size()-1);
+            if(!world.eval(cmds[dist(random)]))
+                return reward(world, false);
+        }
+        return reward(world, true);
+    }
+
+    double MctsOptimizer::reward(const game::WorldEval &world, bool alive) const
+    {
+        if(!alive)
+            return 0.0;
+        const auto &w = world.getWorld();
+        const auto fraction = [](double part, double total) {
+            return total > 0.0?part/total:1.0;
+        };
+        const auto points = fraction(w.dataPoints.size(), reference.points);
+        const auto kills = fraction(reference.enemies - w.enemies.size(),
+            reference.enemies);
+        const auto damage = fraction(
+            reference.totalHealth - world.getTotalHealth(),
+            reference.totalHealth);
+        return 0.6*points + 0.3*kills + 0.1*damage;
+    }
+
+    void MctsOptimizer::backpropagate(NodeIdx idx, double value)
+    {
+        for(; idx != NO_NODE; idx = nodes[idx].parent)
+        {
+            auto &node = nodes[idx];
+            node.visits += 1;
+            node.value += value;
+        }
+    }
+
+    MctsOptimizer::NodeIdx MctsOptimizer::mostVisitedChild(NodeIdx idx) const
+    {
+        auto res = NO_NODE;
+        size_t maxVisits = 0;
+        for(auto c = nodes[idx].firstChild; c != NO_NODE; c = nodes[c].nextSibling)
+        {
+            if(nodes[c].alive && nodes[c].visits > maxVisits)
+            {
+                maxVisits = nodes[c].visits;
+                res = c;
+            }
+        }
+        return res;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include "game.h"
+#include "optimizer.h"
+#include "arena.h"
+
+namespace optimizer
+{
+    using namespace std;
+
+    struct MctsConfig
+    {
+        MctsConfig()
+            :exploration(1.41), rolloutDepth(20), seed(1)
+        {}
+
+        // UCT exploration constant
+        double exploration;
+        // turns simulated by a random rollout
+        size_t rolloutDepth;
+        unsigned int seed;
+    };
+
+    // Monte Carlo tree search: UCT selection, random rollouts over the
+    // commands of the search producers. The subtree of the played command is
+    // kept for the next turn.
+    class MctsOptimizer: public Engine
+    {
+    public:
+        MctsOptimizer(const CmdProducer &cmdProducer,
+            const MctsConfig &config = MctsConfig());
+        MctsOptimizer(const MctsOptimizer&) = delete;
+        MctsOptimizer &operator=(const MctsOptimizer&) = delete;
+
+        pair<game::Cmd, bool> optimize(const game::World &world,
+            chrono::milliseconds timeLimit) override;
+
+        pair<Criteria, bool> bestCriteria() const override;
+
+        // size of the kept tree
+        size_t nodeCount() const
+        {
+            return nodes.size();
+        }
+        // visits of the root, the ones of a reused subtree included
+        size_t rootVisits() const
+        {
+            return root != NO_NODE?nodes[root].visits:0;
+        }
+
+    private:
+        using NodeIdx = size_t;
+        static constexpr NodeIdx NO_NODE = arena::NO_IDX;
+        struct Node
+        {
+            game::Cmd cmd;
+            // state after the command
+            game::WorldEval world;
+            SearchState state;
+            bool alive;
+            CmdCol untried;
+            size_t visits;
+            double value;
+            NodeIdx parent;
+            NodeIdx firstChild;
+            NodeIdx lastChild;
+            NodeIdx nextSibling;
+        };
+        using NodeArena = arena::Arena<Node>;
+        using NodeIdxCol = vector<NodeIdx>;
+
+        struct Reference
+        {
+            size_t points;
+            size_t enemies;
+            int totalHealth;
+        };
+
+        void reset(const game::World &world);
+        NodeIdx addNode(const game::Cmd &cmd, const game::WorldEval &world,
+            const SearchState &state, bool alive, NodeIdx parent);
+        // the commands inside the zone, valid until the next call
+        const CmdBuffer &produceCmds(const game::WorldEval &world);
+        bool isTerminal(const Node &node) const;
+        NodeIdx select(NodeIdx idx) const;
+        NodeIdx expand(NodeIdx idx);
+        double rollout(const Node &node);
+        double reward(const game::WorldEval &world, bool alive) const;
+        void backpropagate(NodeIdx idx, double value);
+        // of the children the player survives
+        NodeIdx mostVisitedChild(NodeIdx idx) const;
+
+        CmdProducer cmdProducer;
+        game::Analysis analysis;
+        CmdBuffer producedCmds;
+        CmdBuffer validCmds;
+        double exploration;
+        size_t rolloutDepth;
+        mt19937 random;
+        NodeArena nodes;
+        NodeArena spareNodes;
+        NodeIdxCol remap;
+        NodeIdx root;
+        NodeIdx nextRoot;
+        Reference reference;
+        Criteria best;
+        bool bestFound;
+    };
+}
+
+#endif
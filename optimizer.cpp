@@ -1,18 +1,63 @@
 #include "optimizer.h"
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cmath>
 #include <cassert>
 
 namespace optimizer
 {
     namespace
     {
-        constexpr bool insideGameZone(const geom::Point &p)
+        // contiguous range of work items, the owner takes them from the front
+        // and idle workers steal from the back
+        class WorkQueue
         {
-            return p.x >= 0 && p.x <= game::ZONE.x &&
-                p.y >= 0 && p.y <= game::ZONE.y;
-        }
+        public:
+            WorkQueue()
+                :m(), first(0), last(0)
+            {}
+
+            void assign(size_t begin, size_t end)
+            {
+                first = begin;
+                last = end;
+            }
+
+            bool pop(size_t &item)
+            {
+                lock_guard<mutex> lock(m);
+                if(first == last)
+                    return false;
+                item = first++;
+                return true;
+            }
 
+            bool steal(size_t &item)
+            {
+                lock_guard<mutex> lock(m);
+                if(first == last)
+                    return false;
+                item = --last;
+                return true;
+            }
+
+        private:
+            mutex m;
+            size_t first;
+            size_t last;
+        };
+
+        // commands of a tree built for another world may shoot at enemies
+        // that are dead in the real one
+        bool targetAlive(const game::WorldEval &world, const game::Cmd &cmd)
+        {
+            return cmd.getType() != game::Cmd::TYPE_SHOOT ||
+                world.enemyAlive(cmd.getShootId());
+        }
     }
     ostream &operator<<(ostream &stream, const optimizer::Criteria &c)
     {
@@ -23,179 +68,539 @@ namespace optimizer
             <<'}';
     }
 
-    Optimizer::Optimizer(const CmdFuncCol &searchCmdProducers)
-        :searchCmdProducers(searchCmdProducers),
-        root(), nextRoot(), bestLeaf(), totalBestLeaf(),
-        unfinishedBestLeaf(), nextLeafs(), unfinishedLeafs(),
+    StateHash makeStateHash(const game::WorldEval &worldEval,
+        const SearchState &s)
+    {
+        const auto &w = worldEval.getWorld();
+        const auto POS_REDUCER = game::ENEMY_STEP_DIST;
+        StateHash res = 0;
+        res = combineHash(res, w.player.pos.x/POS_REDUCER);
+        res = combineHash(res, w.player.pos.y/POS_REDUCER);
+        res = combineHash(res, s.shotsFired);
+        res = combineHash(res, s.totalDamage);
+        // order independent sets of alive ids
+        res = combineHash(res, worldEval.getEnemyIdsHash());
+        return combineHash(res, worldEval.getDataPointIdsHash());
+    }
+
+    Criteria makeCriteriaBound(const game::WorldEval &worldEval,
+        const SearchState &s)
+    {
+        // the player dies within DEATH_DIST
+        static const int maxDamage = game::WorldEval::calcDamageDist2(
+            static_cast<int64_t>(game::DEATH_DIST)*game::DEATH_DIST + 1);
+        static thread_local vector<unsigned char> lostPoints;
+        const auto &w = worldEval.getWorld();
+        lostPoints.assign(worldEval.getMaxDataPointId()+1, 0);
+        size_t lostCount = 0;
+        size_t minShots = 0;
+        for(const auto &e : w.enemies)
+        {
+            const size_t shots = (e.life + maxDamage - 1)/maxDamage;
+            minShots += shots;
+            const auto ep = worldEval.getEnemyPoint(e.id);
+            if(!ep.second)
+                continue;
+            // a step gets at least ENEMY_STEP_DIST-2 closer with the
+            // truncation, the capture turn has a shot before it
+            const auto dist = geom::dist(e.pos, ep.first.pos);
+            const auto turns = 1 + static_cast<size_t>(ceil(
+                    max(0.0, dist - game::ENEMY_STEP_DIST)/
+                    (game::ENEMY_STEP_DIST - 2)));
+            if(shots > turns && !lostPoints[ep.first.id])
+            {
+                lostPoints[ep.first.id] = 1;
+                ++lostCount;
+            }
+        }
+        return Criteria{
+            s.shotsFired + minShots,
+            w.dataPoints.size() - lostCount,
+            0,
+            s.totalDamage + worldEval.getTotalHealth()
+        };
+    }
+
+    constexpr Optimizer::NodeIdx Optimizer::NO_NODE;
+    constexpr size_t Optimizer::PARALLEL_BATCH;
+
+    Optimizer::Optimizer(const CmdProducer &cmdProducer,
+        const OptimizerConfig &config)
+        :cmdProducer(cmdProducer), order(config.order),
+        boundPruning(config.boundPruning),
+        maxNodes(config.maxNodes), maxTreeBytes(config.maxTreeBytes),
+        salvageTree(config.salvageTree),
+        stableLevels(config.stableLevels), treeBytes(0), trimmedLeafs(0),
+        nodes(), spareNodes(), remap(),
+        root(NO_NODE), nextRoot(NO_NODE), bestLeaf(NO_NODE),
+        totalBestLeaf(NO_NODE), unfinishedBestLeaf(NO_NODE),
+        nextLeafs(), unfinishedLeafs(), frontier(), frontierEntries(),
+        frontierSeq(0),
         depth(0),
-        seenStates()
-    {}
+        seenStates(config.seenStatesBytes, config.seenStatesPolicy),
+        expansions(1), threadEvals(config.order == SearchOrder::LEVEL
+            ?max<size_t>(config.threads, 1):1, 0),
+        prunedNodes(0),
+        cursors(), batch(), workerPool(threadEvals.size()),
+        ponderThread(), stopSearch(false)
+    {
+        if(config.order == SearchOrder::BEST_FIRST && config.threads > 1)
+        {
+            cerr<<"best first order runs on one thread, ignoring threads="
+                <<config.threads<<endl;
+        }
+    }
+
+    Optimizer::~Optimizer()
+    {
+        stopPondering();
+    }
 
     pair<game::Cmd, bool> Optimizer::optimize(const game::World &world,
         chrono::milliseconds timeLimit)
     {
         const auto beginTime = Clock::now();
-        bool timeout = false;
-        if(!root || !nextRoot)
+        stopPondering();
+        fill(threadEvals.begin(), threadEvals.end(), 0);
+        prunedNodes = 0;
+        trimmedLeafs = 0;
+        if(root == NO_NODE || nextRoot == NO_NODE)
         {
             reset(world);
         }
         else
         {
-            if(nextRoot->data.world.getWorld() != world)
+            auto &cursor = cursors.front();
+            moveCursor(cursor, nextRoot, false);
+            if(cursor.world.getWorld() != world)
             {
-                cerr<<"predicted world mismatch, reseting optimization tree"<<endl;
-                reset(world);
+                if(salvageTree)
+                {
+                    cerr<<"predicted world mismatch, salvaging optimization tree"<<endl;
+                    // the search keeps at least half of the turn
+                    salvage(world, beginTime + timeLimit/2);
+                }
+                else
+                {
+                    cerr<<"predicted world mismatch, reseting optimization tree"<<endl;
+                    reset(world);
+                }
             }
-            else
+            else if(nextRoot != root)
             {
-                // reset dropped paths
-                root = nextRoot;
+                // unless pondering already did it
+                advanceRoot(nextRoot);
             }
         }
-        size_t worldEvals = 0;
+        // the rest of the level may be in the dropped subtrees
         if(unfinishedLeafs.empty())
+            swap(unfinishedLeafs, nextLeafs);
+        if(frontierEmpty())
             cerr<<"search tree is fully built"<<endl;
-        while(!unfinishedLeafs.empty())
+        search(beginTime + timeLimit, true);
+        if(overBudget())
+            cerr<<"optimizer memory budget reached"<<endl;
+        bestLeaf = bestResultNode(
+            bestLeaf, totalBestLeaf);
+        const auto cur = (bestLeaf != NO_NODE?rootChild(bestLeaf):NO_NODE);
+        if(cur != NO_NODE)
         {
-            while(!unfinishedLeafs.empty())
-            {
-                if(Clock::now() - beginTime >= timeLimit)
-                {
-                    timeout = true;
-                    break;
-                }
-                auto cur = unfinishedLeafs.front().lock();
-                unfinishedLeafs.pop_front();
-                if(!cur)
-                    continue;
-                if(totalBestLeaf &&
-                    lessDropCriteria(makeCriteria(cur->data),
-                        makeCriteria(totalBestLeaf->data)))
-                {
-                    continue;
-                }
-                const auto &cmd = cur->data.cmd;
-                if(cmd.getType() == game::Cmd::TYPE_MOVE)
-                {
-                    if(!insideGameZone(cmd.getMovePoint()))
-                        continue;
-                }
-                auto &worldEval = cur->data.world;
-                const auto totalHealthBefore = worldEval.getTotalHealth();
-                const auto validWorld = worldEval.eval(cur->data.cmd);
-                ++worldEvals;
-                int totalDamage = cur->data.state.totalDamage;
-                size_t shotsFired = cur->data.state.shotsFired;
-                if(cmd.getType() == game::Cmd::TYPE_SHOOT)
-                {
-                    totalDamage += totalHealthBefore -
-                        worldEval.getTotalHealth();
-                    shotsFired += 1;
-                }
-                const State nextState{shotsFired, totalDamage};
-                cur->data.state = nextState;
-                if(validWorld)
-                {
-                    if(!seenStates.insert(makeReducedState(worldEval, nextState)).second)
-                        continue;
-                    unfinishedBestLeaf = bestResultNode(
-                        unfinishedBestLeaf.lock(), cur);
-                    if(worldEval.getWorld().enemies.empty() ||
-                        worldEval.getWorld().dataPoints.empty())
-                    {
-                        totalBestLeaf = bestResultNode(
-                            totalBestLeaf, cur);
-                        continue;
-                    }
-                    for(const auto &f : searchCmdProducers)
-                    {
-                        const auto cmds = f(worldEval);
-                        for(const auto &c : cmds)
-                        {
-                            shared_ptr<Node> node(
-                                new Node{
-                                NodeData{
-                                c,
-                                worldEval,
-                                nextState
-                                },
-                                NodePtrCol(),
-                                weak_ptr<Node>(cur)});
-                            cur->children.push_back(node);
-                            nextLeafs.push_back(node);
-                        }
-                    }
-                    if(timeout)
-                        break;
-                }
-            }
-            if(!timeout)
+            const auto criteria = makeCriteria(nodes[bestLeaf].data);
+            nextRoot = cur;
+            printStats(beginTime);
+            cerr<<"optimized result: "<<criteria<<endl;
+            // a salvaged tree may be deeper than its completed levels
+            if(depth > 0)
+                --depth;
+            return make_pair(nodes[cur].data.cmd, true);
+        }
+        else
+        {
+            nextRoot = NO_NODE;
+            printStats(beginTime);
+            cerr<<"no optimized result"<<endl;
+            return make_pair(game::Cmd::makeMoveCmd(world.player.pos), false);
+        }
+    }
+
+    void Optimizer::search(Clock::time_point deadline, bool untilStable)
+    {
+        NodeIdx lastCmd = NO_NODE;
+        size_t sameCmdLevels = 0;
+        if(order == SearchOrder::BEST_FIRST && !frontierEmpty())
+        {
+            if(!expandBestFirst(deadline))
+                cerr<<"full optimization tree is built"<<endl;
+            bestLeaf = unfinishedBestLeaf;
+        }
+        while(order == SearchOrder::LEVEL && !unfinishedLeafs.empty())
+        {
+            const auto stopped = (threadEvals.size() > 1
+                ?expandLevelParallel(deadline)
+                :expandLevel(deadline));
+            if(!stopped)
             {
                 ++depth;
                 assert(unfinishedLeafs.empty());
                 unfinishedLeafs = move(nextLeafs);
+                trimLevel();
                 bestLeaf = bestResultNode(
-                    totalBestLeaf, unfinishedBestLeaf.lock());
-                unfinishedBestLeaf.reset();
+                    totalBestLeaf, unfinishedBestLeaf);
+                unfinishedBestLeaf = NO_NODE;
                 if(unfinishedLeafs.empty())
                 {
                     cerr<<"full optimization tree is built"<<endl;
                     break;
                 }
+                if(untilStable && stableLevels > 0)
+                {
+                    const auto cmd = (bestLeaf != NO_NODE
+                        ?rootChild(bestLeaf):NO_NODE);
+                    sameCmdLevels = (cmd != NO_NODE && cmd == lastCmd
+                        ?sameCmdLevels+1:1);
+                    lastCmd = cmd;
+                    if(cmd != NO_NODE && sameCmdLevels >= stableLevels)
+                    {
+                        cerr<<"best command is stable, stopping the search"<<endl;
+                        break;
+                    }
+                }
             }
             else
             {
                 break;
             }
         }
-        bestLeaf = bestResultNode(
-            bestLeaf.lock(), totalBestLeaf);
-        auto cur = bestLeaf.lock();
-        shared_ptr<Node> parent;
-        if(cur)
-            parent = cur->parent.lock();
-        if(cur && parent)
-        {
-            const auto criteria = makeCriteria(cur->data);
-            while(true)
+    }
+
+    void Optimizer::ponder()
+    {
+        stopPondering();
+        if(root == NO_NODE || nextRoot == NO_NODE)
+            return;
+        fill(threadEvals.begin(), threadEvals.end(), 0);
+        // dropping the rest of the tree is left to the thread too
+        ponderThread = thread([this]() {
+            // only the predicted subtree can be used in the next turn, the
+            // compaction can't be stopped so a turn that already began
+            // leaves it to optimize
+            if(stopSearch)
+                return;
+            advanceRoot(nextRoot);
+            search(Clock::time_point::max(), false);
+        });
+    }
+
+    void Optimizer::stopPondering()
+    {
+        if(!ponderThread.joinable())
+            return;
+        stopSearch = true;
+        ponderThread.join();
+        stopSearch = false;
+        size_t worldEvals = 0;
+        for(const auto e : threadEvals)
+            worldEvals += e;
+        cerr<<"pondering stats: depth="<<depth<<" evals="<<worldEvals
+            <<" nodes="<<nodes.size()<<endl;
+    }
+
+    bool Optimizer::expandLevel(Clock::time_point deadline)
+    {
+        auto &expansion = expansions.front();
+        while(!unfinishedLeafs.empty())
+        {
+            if(timeUp(deadline) || overBudget())
+                return true;
+            const auto cur = unfinishedLeafs.front();
+            unfinishedLeafs.pop_front();
+            if(dropLeaf(cur))
+                continue;
+            expandLeaf(cur, expansion, cursors.front());
+            if(expansion.evaluated)
+                ++threadEvals.front();
+            mergeLeaf(cur, expansion);
+        }
+        return false;
+    }
+
+    bool Optimizer::expandLevelParallel(Clock::time_point deadline)
+    {
+        const auto threadCount = threadEvals.size();
+        const auto batchSize = PARALLEL_BATCH*threadCount;
+        if(expansions.size() < batchSize)
+            expansions.resize(batchSize);
+        vector<WorkQueue> queues(threadCount);
+        atomic<bool> timeout(false);
+        const pool::WorkerPool::Job work = [&](size_t t) {
+            size_t item = 0;
+            while(!timeout)
             {
-                auto grandParent = parent->parent.lock();
-                if(!grandParent)
+                bool found = queues[t].pop(item);
+                for(size_t i = 1; !found && i < threadCount; ++i)
+                    found = queues[(t+i)%threadCount].steal(item);
+                if(!found)
                     break;
-                cur = parent;
-                parent = grandParent;
+                auto &expansion = expansions[item];
+                if(timeUp(deadline))
+                {
+                    timeout = true;
+                    break;
+                }
+                expandLeaf(batch[item], expansion, cursors[t]);
+                expansion.done = true;
+                if(expansion.evaluated)
+                    ++threadEvals[t];
             }
-            parent.reset();
-            assert(cur);
-            nextRoot = cur;
-            assert(depth > 0);
-            cerr<<"optimizer stats: depth="<<depth<<" time="
-                <<chrono::duration_cast<chrono::milliseconds>(Clock::now()-beginTime).count()
-                <<" evals="<<worldEvals
-                <<endl;
-            cerr<<"optimized result: "<<criteria<<endl;
-            --depth;
-            return make_pair(cur->data.cmd, true);
+        };
+        while(!unfinishedLeafs.empty())
+        {
+            if(overBudget())
+                return true;
+            const auto count = min(batchSize, unfinishedLeafs.size());
+            batch.assign(unfinishedLeafs.begin(),
+                unfinishedLeafs.begin() + count);
+            unfinishedLeafs.erase(unfinishedLeafs.begin(),
+                unfinishedLeafs.begin() + count);
+            for(size_t i = 0; i < count; ++i)
+                expansions[i].done = false;
+            for(size_t t = 0; t < threadCount; ++t)
+                queues[t].assign(count*t/threadCount, count*(t+1)/threadCount);
+            workerPool.run(work);
+            // merging in frontier order gives the same tree for any thread
+            // count, the leafs left go back to the front in their order
+            bool full = false;
+            size_t left = 0;
+            for(size_t i = 0; i < count; ++i)
+            {
+                const auto &cur = batch[i];
+                auto &expansion = expansions[i];
+                full = full || overBudget();
+                if(!expansion.done || full)
+                    batch[left++] = cur;
+                else if(!dropLeaf(cur))
+                    mergeLeaf(cur, expansion);
+            }
+            unfinishedLeafs.insert(unfinishedLeafs.begin(), batch.begin(),
+                batch.begin() + left);
+            if(timeout || full)
+                return true;
+        }
+        return false;
+    }
+
+    bool Optimizer::expandBestFirst(Clock::time_point deadline)
+    {
+        auto &expansion = expansions.front();
+        const auto rootLevel = nodes[root].level;
+        while(!frontier.empty())
+        {
+            if(timeUp(deadline) || overBudget())
+                return true;
+            const auto cur = frontier.top().leaf;
+            frontier.pop();
+            if(dropLeaf(cur))
+                continue;
+            expandLeaf(cur, expansion, cursors.front());
+            if(expansion.evaluated)
+                ++threadEvals.front();
+            depth = max(depth, nodes[cur.parent].level + 1 - rootLevel);
+            mergeLeaf(cur, expansion);
+        }
+        return false;
+    }
+
+    void Optimizer::trimLevel()
+    {
+        if(unfinishedLeafs.empty())
+            return;
+        // every leaf may become a node of about the average size
+        const auto leafBytes = max(treeBytes/nodes.size(), sizeof(Node));
+        const auto used = usedBytes();
+        auto room = (used < maxTreeBytes?(maxTreeBytes-used)/leafBytes:0);
+        room = min(room, nodes.size() < maxNodes?maxNodes-nodes.size():0);
+        if(unfinishedLeafs.size() <= room)
+            return;
+        cerr<<"optimizer memory budget reached, trimming the level from "
+            <<unfinishedLeafs.size()<<" to "<<room<<" leafs"<<endl;
+        trimmedLeafs += unfinishedLeafs.size() - room;
+        vector<size_t> order(unfinishedLeafs.size());
+        for(size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        stable_sort(order.begin(), order.end(),
+            [this](size_t left, size_t right) {
+                return makeCriteria(nodes[unfinishedLeafs[right].parent].data) <
+                    makeCriteria(nodes[unfinishedLeafs[left].parent].data);
+            });
+        order.resize(room);
+        // the kept leafs stay in the level order
+        sort(order.begin(), order.end());
+        LeafList kept;
+        for(const auto i : order)
+            kept.push_back(unfinishedLeafs[i]);
+        unfinishedLeafs = move(kept);
+    }
+
+    void Optimizer::addLeaf(const Leaf &leaf, LeafList &levelLeafs)
+    {
+        if(order == SearchOrder::BEST_FIRST)
+        {
+            const auto &parent = nodes[leaf.parent];
+            frontier.push(FrontierEntry{parent.data.criteria,
+                parent.level+1, frontierSeq++, leaf});
         }
         else
         {
-            nextRoot.reset();
-            cerr<<"optimizer stats: depth="<<depth<<" time="
-                <<chrono::duration_cast<chrono::milliseconds>(Clock::now()-beginTime).count()
-                <<" evals="<<worldEvals
-                <<endl;
-            cerr<<"no optimized result"<<endl;
-            return make_pair(game::Cmd::makeMoveCmd(world.player.pos), false);
+            levelLeafs.push_back(leaf);
+        }
+    }
+
+    bool Optimizer::dropLeaf(const Leaf &leaf) const
+    {
+        return totalBestLeaf != NO_NODE &&
+            lessDropCriteria(makeCriteria(nodes[leaf.parent].data),
+                makeCriteria(nodes[totalBestLeaf].data));
+    }
+
+    bool Optimizer::pruneNode(const Criteria &bound) const
+    {
+        return boundPruning && totalBestLeaf != NO_NODE &&
+            bound < makeCriteria(nodes[totalBestLeaf].data);
+    }
+
+    void Optimizer::expandLeaf(const Leaf &leaf, Expansion &expansion,
+        Cursor &cursor)
+    {
+        expansion.evaluated = false;
+        expansion.valid = false;
+        expansion.produced = false;
+        expansion.bounded = false;
+        expansion.children.clear();
+        const auto &cmd = leaf.cmd;
+        if(cmd.getType() == game::Cmd::TYPE_MOVE)
+        {
+            if(!game::insideZone(cmd.getMovePoint()))
+                return;
+        }
+        const auto &parentData = nodes[leaf.parent].data;
+        auto &data = expansion.data;
+        data.cmd = cmd;
+        moveCursor(cursor, leaf.parent, true);
+        auto &worldEval = cursor.world;
+        if(!targetAlive(worldEval, cmd))
+            return;
+        const auto totalHealthBefore = worldEval.getTotalHealth();
+        expansion.valid = worldEval.evalStepped(cmd, parentData.step,
+            data.delta);
+        expansion.evaluated = true;
+        SearchState nextState{parentData.criteria.shotsFired,
+            parentData.criteria.totalDamage};
+        if(cmd.getType() == game::Cmd::TYPE_SHOOT)
+        {
+            nextState.totalDamage += totalHealthBefore -
+                worldEval.getTotalHealth();
+            nextState.shotsFired += 1;
         }
+        data.criteria = optimizer::makeCriteria(worldEval, nextState);
+        if(expansion.valid)
+        {
+            const auto finished = isFinished(data.criteria);
+            if(boundPruning && !finished)
+            {
+                expansion.bounded = true;
+                expansion.bound = makeCriteriaBound(worldEval, nextState);
+            }
+            // the bound is checked again on merge against a possibly
+            // better incumbent
+            if(!expansion.bounded || !pruneNode(expansion.bound))
+            {
+                expansion.hash = makeStateHash(worldEval, nextState);
+                if(!seenStates.contains(expansion.hash) && !finished)
+                    produceChildren(expansion, cursor);
+            }
+        }
+        worldEval.undo(data.delta);
+    }
+
+    void Optimizer::produceChildren(Expansion &expansion, Cursor &cursor)
+    {
+        auto &world = cursor.world;
+        cursor.analysis.update(world);
+        cursor.cmds.clear();
+        cmdProducer(world, cursor.analysis, cursor.cmds);
+        expansion.children.assign(cursor.cmds.begin(), cursor.cmds.end());
+        world.step(expansion.data.step);
+        world.undo(expansion.data.step);
+        expansion.produced = true;
+    }
+
+    Optimizer::NodeIdx Optimizer::mergeNode(const Leaf &leaf,
+        Expansion &expansion)
+    {
+        if(!expansion.valid)
+            return NO_NODE;
+        if(expansion.bounded && pruneNode(expansion.bound))
+        {
+            ++prunedNodes;
+            return NO_NODE;
+        }
+        // the frontier of the level order is at the depth
+        const auto nodeDepth = nodes[leaf.parent].level - nodes[root].level;
+        if(!seenStates.insert(expansion.hash, nodeDepth))
+            return NO_NODE;
+        // the state could be evicted from seenStates after it was checked
+        if(!expansion.produced && !isFinished(expansion.data.criteria))
+        {
+            auto &cursor = cursors.front();
+            moveCursor(cursor, leaf.parent, true);
+            cursor.world.apply(expansion.data.delta);
+            produceChildren(expansion, cursor);
+            cursor.world.undo(expansion.data.delta);
+        }
+        expansion.data.hash = expansion.hash;
+        const auto idx = addNode(move(expansion.data), leaf.parent);
+        // the best first order mixes the levels
+        unfinishedBestLeaf = bestOrDeeperResultNode(unfinishedBestLeaf, idx);
+        if(isFinished(nodes[idx].data.criteria))
+            totalBestLeaf = bestResultNode(totalBestLeaf, idx);
+        return idx;
+    }
+
+    void Optimizer::mergeLeaf(const Leaf &leaf, Expansion &expansion)
+    {
+        const auto idx = mergeNode(leaf, expansion);
+        if(idx == NO_NODE || isFinished(nodes[idx].data.criteria))
+            return;
+        for(const auto &c : expansion.children)
+            addLeaf(Leaf{idx, c}, nextLeafs);
+    }
+
+    void Optimizer::printStats(Clock::time_point beginTime) const
+    {
+        size_t worldEvals = 0;
+        for(const auto e : threadEvals)
+            worldEvals += e;
+        cerr<<"optimizer stats: depth="<<depth<<" time="
+            <<chrono::duration_cast<chrono::milliseconds>(Clock::now()-beginTime).count()
+            <<" evals="<<worldEvals
+            <<" nodes="<<nodes.size()
+            <<" pruned="<<prunedNodes
+            <<" trimmed="<<trimmedLeafs
+            <<" bytes="<<usedBytes();
+        if(threadEvals.size() > 1)
+        {
+            cerr<<" thread evals=";
+            for(size_t t = 0; t < threadEvals.size(); ++t)
+                cerr<<(t > 0?",":"")<<threadEvals[t];
+        }
+        cerr<<endl;
     }
 
     pair<Criteria, bool> Optimizer::bestCriteria() const
     {
-        auto bestLeafLock = bestLeaf.lock();
-        if(bestLeafLock)
+        if(bestLeaf != NO_NODE)
         {
-            return make_pair(makeCriteria(bestLeafLock->data), true);
+            return make_pair(makeCriteria(nodes[bestLeaf].data), true);
         }
         else
         {
@@ -205,80 +610,286 @@ namespace optimizer
 
     void Optimizer::reset(const game::World &world)
     {
-        const State nextState{0, 0};
-        root.reset(new Node{
-            NodeData{
+        resetRoot(world);
+        for(const auto &c : produceRootCmds())
+            addLeaf(Leaf{root, c}, unfinishedLeafs);
+    }
+
+    const CmdBuffer &Optimizer::produceRootCmds()
+    {
+        auto &cursor = cursors.front();
+        cursor.analysis.update(cursor.world);
+        cursor.cmds.clear();
+        cmdProducer(cursor.world, cursor.analysis, cursor.cmds);
+        return cursor.cmds;
+    }
+
+    void Optimizer::resetRoot(const game::World &world)
+    {
+        nodes.clear();
+        const game::WorldEval worldEval(world);
+        const auto criteria = optimizer::makeCriteria(worldEval,
+            SearchState{0, 0});
+        root = addNode(NodeData{
             game::Cmd::makeMoveCmd(world.player.pos),
-            game::WorldEval(world),
-            nextState
-            },
-            NodePtrCol(),
-            weak_ptr<Node>()});
+            criteria,
+            game::WorldEval::Delta(),
+            game::WorldEval::Step(),
+            makeStateHash(worldEval, SearchState{0, 0})
+            }, NO_NODE);
         nextRoot = root;
-        bestLeaf.reset();
-        totalBestLeaf.reset();
-        unfinishedBestLeaf.reset();
+        game::WorldEval(worldEval).step(nodes[root].data.step);
+        treeBytes = nodeBytes(nodes[root]);
+        cursors.assign(threadEvals.size(),
+            Cursor{worldEval, root, false, NodeIdxCol(), game::Analysis(),
+                CmdBuffer()});
+        bestLeaf = NO_NODE;
+        totalBestLeaf = NO_NODE;
+        unfinishedBestLeaf = NO_NODE;
         nextLeafs.clear();
         depth = 0;
         seenStates.clear();
         unfinishedLeafs.clear();
-        for(const auto &f : searchCmdProducers)
+        frontier.clear();
+        frontierSeq = 0;
+    }
+
+    void Optimizer::salvage(const game::World &world,
+        Clock::time_point deadline)
+    {
+        arena::compactTree(nodes, spareNodes, nextRoot, remap);
+        // the old leafs by the compacted index of the parent, the leafs of
+        // a parent keep their order
+        LeafCol oldUnfinished;
+        LeafCol oldNext;
+        const auto keepLeaf = [this](const Leaf &leaf, LeafCol &res) {
+            if(remap[leaf.parent] != NO_NODE)
+                res.push_back(Leaf{remap[leaf.parent], leaf.cmd});
+        };
+        for(const auto &leaf : unfinishedLeafs)
+            keepLeaf(leaf, oldUnfinished);
+        for(const auto &leaf : nextLeafs)
+            keepLeaf(leaf, oldNext);
+        for(const auto &e : frontier.elements())
+            keepLeaf(e.leaf, oldUnfinished);
+        const auto lessParent = [](const Leaf &left, const Leaf &right) {
+            return left.parent < right.parent;
+        };
+        stable_sort(oldUnfinished.begin(), oldUnfinished.end(), lessParent);
+        stable_sort(oldNext.begin(), oldNext.end(), lessParent);
+        // the old subtree stays in the spare arena while the new one is built
+        nodes.swap(spareNodes);
+        const auto &oldNodes = spareNodes;
+        resetRoot(world);
+        remap.assign(oldNodes.size(), NO_NODE);
+        remap[0] = root;
+        // the old nodes are in the breadth first order, so the parents of
+        // the sorted leafs are visited in order
+        CmdCol oldCmds;
+        size_t unfinishedPos = 0;
+        size_t nextPos = 0;
+        auto &cursor = cursors.front();
+        // the cursor is at the new parent
+        const auto moveLeafs = [this, &oldCmds, &cursor](NodeIdx oldParent,
+            const LeafCol &leafs, size_t &pos, LeafList &levelLeafs) {
+            while(pos < leafs.size() && leafs[pos].parent < oldParent)
+                ++pos;
+            for(; pos < leafs.size() && leafs[pos].parent == oldParent; ++pos)
+            {
+                oldCmds.push_back(leafs[pos].cmd);
+                if(targetAlive(cursor.world, leafs[pos].cmd))
+                    addLeaf(Leaf{remap[oldParent], leafs[pos].cmd}, levelLeafs);
+            }
+        };
+        // The commands missing from the old node were dropped in the
+        // predicted world, mostly as seen states, and the nodes of those
+        // states may be gone. They are new leafs, in the real world they
+        // may be kept.
+        const auto moveChildren = [&](NodeIdx oldIdx, const CmdCol &cmds) {
+            oldCmds.clear();
+            moveCursor(cursor, remap[oldIdx], false);
+            moveLeafs(oldIdx, oldUnfinished, unfinishedPos, unfinishedLeafs);
+            moveLeafs(oldIdx, oldNext, nextPos, nextLeafs);
+            for(auto c = oldNodes[oldIdx].firstChild; c != NO_NODE;
+                c = oldNodes[c].nextSibling)
+            {
+                oldCmds.push_back(oldNodes[c].data.cmd);
+            }
+            for(const auto &cmd : cmds)
+            {
+                if(find(oldCmds.begin(), oldCmds.end(), cmd) == oldCmds.end())
+                    addLeaf(Leaf{remap[oldIdx], cmd}, unfinishedLeafs);
+            }
+        };
+        const auto &rootCmds = produceRootCmds();
+        moveChildren(0, CmdCol(rootCmds.begin(), rootCmds.end()));
+        auto &expansion = expansions.front();
+        auto salvagedBest = NO_NODE;
+        size_t kept = 0;
+        bool stopped = false;
+        for(NodeIdx i = 1; i < oldNodes.size(); ++i)
         {
-            const auto cmds = f(world);
-            for(const auto &c : cmds)
+            const auto parent = remap[oldNodes[i].parent];
+            if(parent == NO_NODE)
+                continue;
+            const Leaf leaf{parent, oldNodes[i].data.cmd};
+            stopped = stopped || Clock::now() >= deadline || overBudget();
+            if(stopped)
             {
-                shared_ptr<Node> node(
-                    new Node{
-                    NodeData{
-                    c,
-                    world,
-                    nextState
-                    },
-                    NodePtrCol(),
-                    weak_ptr<Node>(root)
-                    });
-                root->children.push_back(node);
-                unfinishedLeafs.push_back(node);
+                moveCursor(cursor, parent, false);
+                if(targetAlive(cursor.world, leaf.cmd))
+                    addLeaf(leaf, unfinishedLeafs);
+                continue;
             }
+            if(dropLeaf(leaf))
+                continue;
+            expandLeaf(leaf, expansion, cursor);
+            if(expansion.evaluated)
+                ++threadEvals.front();
+            const auto idx = mergeNode(leaf, expansion);
+            if(idx == NO_NODE)
+                continue;
+            ++kept;
+            salvagedBest = bestOrDeeperResultNode(salvagedBest, idx);
+            if(isFinished(nodes[idx].data.criteria))
+                continue;
+            remap[i] = idx;
+            moveChildren(i, expansion.children);
+        }
+        cerr<<"salvaged "<<kept<<" of "<<oldNodes.size()-1<<" nodes"<<endl;
+        spareNodes.clear();
+        // the nodes are added level by level, the level order continues
+        // from the shallowest leaf
+        depth = nodes[nodes.size()-1].level - nodes[root].level;
+        if(order == SearchOrder::LEVEL)
+        {
+            for(const auto &leaf : unfinishedLeafs)
+                depth = min(depth, nodes[leaf.parent].level - nodes[root].level);
         }
+        bestLeaf = bestResultNode(salvagedBest, totalBestLeaf);
+        unfinishedBestLeaf = (order == SearchOrder::BEST_FIRST
+            ?salvagedBest:NO_NODE);
     }
 
-    ReducedState Optimizer::makeReducedState(
-        const game::WorldEval &worldEval, const State &s)
+    Optimizer::NodeIdx Optimizer::addNode(NodeData data, NodeIdx parent)
     {
-        const auto &w = worldEval.getWorld();
-        FlagCol enemies(worldEval.getMaxEnemyId()+1, false);
-        for(const auto &e : w.enemies)
+        const auto level = (parent != NO_NODE?nodes[parent].level+1:0);
+        const auto idx = nodes.emplace(
+            Node{move(data), parent, NO_NODE, NO_NODE, NO_NODE, level});
+        treeBytes += nodeBytes(nodes[idx]);
+        if(parent != NO_NODE)
+            arena::appendChild(nodes, parent, idx);
+        return idx;
+    }
+
+    void Optimizer::moveCursor(Cursor &cursor, NodeIdx target,
+        bool stepped) const
+    {
+        auto &world = cursor.world;
+        // to the parent in the stepped state
+        const auto climb = [this, &cursor, &world]() {
+            const auto &data = nodes[cursor.node].data;
+            if(cursor.stepped)
+                world.undo(data.step);
+            world.undo(data.delta);
+            cursor.node = nodes[cursor.node].parent;
+            cursor.stepped = true;
+        };
+        cursor.path.clear();
+        while(nodes[cursor.node].level > nodes[target].level)
+            climb();
+        while(nodes[target].level > nodes[cursor.node].level)
         {
-            const auto id = e.id;
-            assert(static_cast<size_t>(id) < enemies.size());
-            enemies[id] = true;
+            cursor.path.push_back(target);
+            target = nodes[target].parent;
         }
-        FlagCol points(worldEval.getMaxDataPointId()+1, false);
-        for(const auto &p : w.dataPoints)
+        while(cursor.node != target)
         {
-            const auto id = p.id;
-            assert(static_cast<size_t>(id) < points.size());
-            points[id] = true;
+            climb();
+            cursor.path.push_back(target);
+            target = nodes[target].parent;
         }
-        const auto POS_REDUCER = game::ENEMY_STEP_DIST;
-        return ReducedState{
-            geom::Point{w.player.pos.x/POS_REDUCER,
-                w.player.pos.y/POS_REDUCER},
-                s.shotsFired,
-                s.totalDamage,
-                move(enemies),
-                move(points)
+        for(auto iter = cursor.path.rbegin(); iter != cursor.path.rend(); ++iter)
+        {
+            if(!cursor.stepped)
+                world.apply(nodes[cursor.node].data.step);
+            world.apply(nodes[*iter].data.delta);
+            cursor.node = *iter;
+            cursor.stepped = false;
+        }
+        if(cursor.stepped != stepped)
+        {
+            if(stepped)
+                world.apply(nodes[cursor.node].data.step);
+            else
+                world.undo(nodes[cursor.node].data.step);
+            cursor.stepped = stepped;
+        }
+    }
+
+    void Optimizer::advanceRoot(NodeIdx newRoot)
+    {
+        auto &mainCursor = cursors.front();
+        moveCursor(mainCursor, newRoot, false);
+        arena::compactTree(nodes, spareNodes, newRoot, remap);
+        // the root delta is already part of the cursor states
+        nodes[0].data.delta.clear();
+        for(auto &c : cursors)
+        {
+            if(&c != &mainCursor)
+                c.world = mainCursor.world;
+            c.node = 0;
+            c.stepped = false;
+        }
+        const auto remapIdx = [this](NodeIdx idx) {
+            return idx != NO_NODE?remap[idx]:NO_NODE;
         };
+        const auto remapLeafs = [this](LeafList &leafs) {
+            LeafList res;
+            for(const auto &leaf : leafs)
+            {
+                if(remap[leaf.parent] != NO_NODE)
+                    res.push_back(Leaf{remap[leaf.parent], leaf.cmd});
+            }
+            leafs = move(res);
+        };
+        remapLeafs(unfinishedLeafs);
+        remapLeafs(nextLeafs);
+        frontierEntries.clear();
+        for(const auto &e : frontier.elements())
+        {
+            if(remap[e.leaf.parent] != NO_NODE)
+            {
+                frontierEntries.push_back(FrontierEntry{e.criteria, e.level,
+                    e.seq, Leaf{remap[e.leaf.parent], e.leaf.cmd}});
+            }
+        }
+        frontier.assign(move(frontierEntries));
+        frontierEntries.clear();
+        root = 0;
+        nextRoot = root;
+        // states of the dropped subtrees may be reached again through the
+        // new root, only the kept nodes stay seen
+        seenStates.clear();
+        treeBytes = nodeBytes(nodes[root]);
+        for(NodeIdx i = 1; i < nodes.size(); ++i)
+        {
+            seenStates.insert(nodes[i].data.hash,
+                nodes[i].level - nodes[root].level - 1);
+            treeBytes += nodeBytes(nodes[i]);
+        }
+        bestLeaf = remapIdx(bestLeaf);
+        totalBestLeaf = remapIdx(totalBestLeaf);
+        unfinishedBestLeaf = remapIdx(unfinishedBestLeaf);
     }
 
-    shared_ptr<Optimizer::Node> Optimizer::bestResultNode(shared_ptr<Node> left,
-        shared_ptr<Node> right)
+    Optimizer::NodeIdx Optimizer::bestResultNode(NodeIdx left,
+        NodeIdx right) const
     {
-        if(left && right)
+        if(left != NO_NODE && right != NO_NODE)
         {
-            const auto leftCriteria = makeCriteria(left->data);
-            const auto rightCriteria = makeCriteria(right->data);
+            const auto leftCriteria = makeCriteria(nodes[left].data);
+            const auto rightCriteria = makeCriteria(nodes[right].data);
             if(leftCriteria < rightCriteria)
                 return right;
             else
@@ -286,10 +897,38 @@ namespace optimizer
         }
         else
         {
-            if(left)
+            if(left != NO_NODE)
                 return left;
             else
                 return right;
         }
     }
+
+    Optimizer::NodeIdx Optimizer::rootChild(NodeIdx node) const
+    {
+        auto parent = nodes[node].parent;
+        if(parent == NO_NODE)
+            return NO_NODE;
+        while(nodes[parent].parent != NO_NODE)
+        {
+            node = parent;
+            parent = nodes[node].parent;
+        }
+        return node;
+    }
+
+    Optimizer::NodeIdx Optimizer::bestOrDeeperResultNode(NodeIdx left,
+        NodeIdx right) const
+    {
+        if(left != NO_NODE && right != NO_NODE &&
+            nodes[left].level != nodes[right].level)
+        {
+            const auto &l = makeCriteria(nodes[left].data);
+            const auto &r = makeCriteria(nodes[right].data);
+            if(l.alivePoints == r.alivePoints &&
+                l.aliveEnemies == r.aliveEnemies)
+                return nodes[left].level > nodes[right].level?left:right;
+        }
+        return bestResultNode(left, right);
+    }
 }
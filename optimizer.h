@@ -4,12 +4,19 @@
 #include <vector>
 #include <functional>
 #include <chrono>
-#include <memory>
-#include <set>
-#include <list>
+#include <deque>
+#include <limits>
 #include <ostream>
+#include <thread>
+#include <atomic>
 
 #include "game.h"
+#include "analysis.h"
+#include "producer.h"
+#include "arena.h"
+#include "heap.h"
+#include "pool.h"
+#include "transposition.h"
 
 namespace optimizer
 {
@@ -17,8 +24,6 @@ namespace optimizer
 
     using Clock = chrono::steady_clock;
 
-    using CmdCol = vector<game::Cmd>;
-    using CmdFuncCol = vector<function<CmdCol(const game::WorldEval&)>>;
 
     struct Criteria
     {
@@ -40,72 +45,236 @@ namespace optimizer
     }
     ostream &operator<<(ostream &stream, const optimizer::Criteria &c);
 
-    using FlagCol = vector<bool>;
-    struct ReducedState
+    struct SearchState
     {
-        geom::Point playerPos;
         size_t shotsFired;
         int totalDamage;
-        FlagCol enemies;
-        FlagCol points;
     };
-    inline bool operator<(const ReducedState &left, const ReducedState &right)
+
+    inline Criteria makeCriteria(const game::WorldEval &w, const SearchState &s)
     {
-        return
-            (left.playerPos < right.playerPos ||
-             (left.playerPos == right.playerPos &&
-              (left.shotsFired < right.shotsFired ||
-               (left.shotsFired == right.shotsFired &&
-                (left.totalDamage < right.totalDamage ||
-                 (left.totalDamage == right.totalDamage &&
-                  (left.enemies < right.enemies ||
-                   (left.enemies == right.enemies &&
-                    (left.points < right.points)))))))));
+        return Criteria{
+            s.shotsFired,
+            w.getWorld().dataPoints.size(),
+            w.getWorld().enemies.size(),
+            s.totalDamage
+        };
     }
-    using ReducedStateSet = set<ReducedState>;
 
-    class Optimizer
+    // Optimistic criteria of any finished state reachable from w: points
+    // whose enemy arrives before it can be killed are lost, every enemy
+    // is killed with shots of the largest damage and all the remaining
+    // health is taken.
+    Criteria makeCriteriaBound(const game::WorldEval &w, const SearchState &s);
+
+    // hash of the state reduced to the player cell, the shots and damage and
+    // the sets of alive enemies and points
+    StateHash makeStateHash(const game::WorldEval &w, const SearchState &s);
+
+    class Engine
+    {
+    public:
+        virtual ~Engine() {}
+
+        virtual pair<game::Cmd, bool> optimize(const game::World &world,
+            chrono::milliseconds timeLimit) = 0;
+
+        virtual pair<Criteria, bool> bestCriteria() const = 0;
+
+        // keeps searching the predicted next turn in the background until
+        // the next optimize call, engines without it do nothing
+        virtual void ponder() {}
+    };
+
+    enum class SearchOrder
+    {
+        // whole frontier levels one after another
+        LEVEL,
+        // the most promising frontier node first, on one thread
+        BEST_FIRST
+    };
+
+    struct OptimizerConfig
+    {
+        OptimizerConfig()
+            :seenStatesBytes(32*1024*1024),
+            seenStatesPolicy(TranspositionTable::REPLACE_OLDEST),
+            threads(1),
+            order(SearchOrder::LEVEL),
+            boundPruning(true),
+            maxNodes(numeric_limits<size_t>::max()),
+            maxTreeBytes(512*1024*1024),
+            salvageTree(true),
+            stableLevels(0)
+        {}
+
+        size_t seenStatesBytes;
+        TranspositionTable::ReplacePolicy seenStatesPolicy;
+        // frontier levels are expanded in parallel when more than one, the
+        // best first order ignores it
+        size_t threads;
+        SearchOrder order;
+        // cut nodes whose criteria bound is below the best finished state
+        bool boundPruning;
+        // Ceilings of the tree nodes and of the bytes of the nodes and the
+        // frontier. At a ceiling the search of the turn stops and the next
+        // level is trimmed to the leaves with the best parents.
+        size_t maxNodes;
+        size_t maxTreeBytes;
+        // on a predicted world mismatch the commands of the tree are
+        // evaluated again from the real world instead of a new search
+        bool salvageTree;
+        // the level search of a turn stops early once the best command
+        // is the same after this many completed levels, 0 to search until
+        // the time limit
+        size_t stableLevels;
+    };
+
+    class Optimizer: public Engine
     {
     public:
-        Optimizer(const CmdFuncCol &searchCmdProducers);
+        Optimizer(const CmdProducer &cmdProducer,
+            const OptimizerConfig &config = OptimizerConfig());
         Optimizer(const Optimizer&) = delete;
         Optimizer &operator=(const Optimizer&) = delete;
+        ~Optimizer() override;
 
         pair<game::Cmd, bool> optimize(const game::World &world,
-            chrono::milliseconds timeLimit);
+            chrono::milliseconds timeLimit) override;
 
-        pair<Criteria, bool> bestCriteria() const;
+        // not while pondering
+        pair<Criteria, bool> bestCriteria() const override;
 
-    private:
-        struct State
+        // size of the kept tree, not while pondering
+        size_t nodeCount() const
         {
-            size_t shotsFired;
-            int totalDamage;
-        };
+            return nodes.size();
+        }
+        // commands waiting for the evaluation
+        size_t leafCount() const
+        {
+            return unfinishedLeafs.size() + nextLeafs.size() + frontier.size();
+        }
+
+        // Moves the root to the predicted next turn and expands its subtree
+        // on a thread, optimize stops it and continues with the tree. Only
+        // starts the thread, the root is moved there.
+        void ponder() override;
+
+    private:
+        // Only the root state is stored, nodes keep the changes made by
+        // their command and full states are rebuilt by cursors. Nodes are
+        // added for merged states only, the frontier holds commands.
         struct NodeData
         {
             game::Cmd cmd;
-            game::WorldEval world;
-            State state;
+            // after the command
+            Criteria criteria;
+            // without the enemy movement, it's in the parent step
+            game::WorldEval::Delta delta;
+            // enemy movement shared by the children
+            game::WorldEval::Step step;
+            // seenStates are rebuilt from the tree when the root moves
+            StateHash hash;
         };
-        struct Node;
-        using NodePtrCol = vector<shared_ptr<Node>>;
-        using NodeWeakPtrList = list<weak_ptr<Node>>;
+        using NodeIdx = size_t;
+        static constexpr NodeIdx NO_NODE = arena::NO_IDX;
         struct Node
         {
             NodeData data;
-            NodePtrCol children;
-            weak_ptr<Node> parent;
+            NodeIdx parent;
+            NodeIdx firstChild;
+            NodeIdx lastChild;
+            NodeIdx nextSibling;
+            size_t level;
         };
+        using NodeArena = arena::Arena<Node>;
+        using NodeIdxCol = vector<NodeIdx>;
+        // command of a node that isn't evaluated yet
+        struct Leaf
+        {
+            NodeIdx parent;
+            game::Cmd cmd;
+        };
+        using LeafList = deque<Leaf>;
+        using LeafCol = vector<Leaf>;
+        // result of evaluating a leaf, the node is added to the tree by
+        // mergeNode
+        struct Expansion
+        {
+            Expansion()
+                :done(false), evaluated(false), valid(false),
+                produced(false), bounded(false), bound(), hash(0),
+                data{game::Cmd::makeMoveCmd(geom::Point{0, 0}), Criteria(),
+                    game::WorldEval::Delta(), game::WorldEval::Step(), 0},
+                children()
+            {}
+
+            bool done;
+            bool evaluated;
+            bool valid;
+            bool produced;
+            // the node is unfinished and has a criteria bound
+            bool bounded;
+            Criteria bound;
+            StateHash hash;
+            NodeData data;
+            CmdCol children;
+        };
+        using ExpansionCol = vector<Expansion>;
+        using CounterCol = vector<size_t>;
+        // full state of some node, moved over the tree by undoing and
+        // applying node deltas
+        struct Cursor
+        {
+            game::WorldEval world;
+            NodeIdx node;
+            // the node step is applied
+            bool stepped;
+            NodeIdxCol path;
+            game::Analysis analysis;
+            CmdBuffer cmds;
+        };
+        using CursorCol = vector<Cursor>;
+        // leaf of the best first search with the parent criteria, kept
+        // inline for the heap comparisons
+        struct FrontierEntry
+        {
+            Criteria criteria;
+            size_t level;
+            // insertion order
+            size_t seq;
+            Leaf leaf;
+        };
+        using FrontierEntryCol = vector<FrontierEntry>;
+        // Alive points never come back, so the parent points bound what
+        // the node can reach. Then fewer enemies, the shallower node,
+        // fewer shots and more damage go first, the older leaf on ties.
+        struct LowerPriority
+        {
+            bool operator()(const FrontierEntry &left,
+                const FrontierEntry &right) const
+            {
+                const auto &l = left.criteria;
+                const auto &r = right.criteria;
+                if(l.alivePoints != r.alivePoints)
+                    return l.alivePoints < r.alivePoints;
+                if(l.aliveEnemies != r.aliveEnemies)
+                    return l.aliveEnemies > r.aliveEnemies;
+                if(left.level != right.level)
+                    return left.level > right.level;
+                if(l.shotsFired != r.shotsFired)
+                    return l.shotsFired > r.shotsFired;
+                if(l.totalDamage != r.totalDamage)
+                    return l.totalDamage < r.totalDamage;
+                return left.seq > right.seq;
+            }
+        };
+        using Frontier = heap::DaryHeap<FrontierEntry, 4, LowerPriority>;
 
-        static Criteria makeCriteria(const NodeData &d)
+        static const Criteria &makeCriteria(const NodeData &d)
         {
-            return Criteria{
-                d.state.shotsFired,
-                d.world.getWorld().dataPoints.size(),
-                d.world.getWorld().enemies.size(),
-                d.state.totalDamage
-            };
+            return d.criteria;
         }
 
         static bool lessDropCriteria(const Criteria &left, const Criteria &right)
@@ -113,21 +282,126 @@ namespace optimizer
             return (left.alivePoints < right.alivePoints);
         }
 
-        static ReducedState makeReducedState(const game::WorldEval &w, const State &s);
+        static bool isFinished(const Criteria &c)
+        {
+            return c.aliveEnemies == 0 || c.alivePoints == 0;
+        }
+
+        // expands the frontier until the deadline or the stop, or until
+        // the best command is stable
+        void search(Clock::time_point deadline, bool untilStable);
+        bool timeUp(Clock::time_point deadline) const
+        {
+            return stopSearch || Clock::now() >= deadline;
+        }
+        void stopPondering();
         void reset(const game::World &world);
-        static shared_ptr<Node> bestResultNode(shared_ptr<Node> left,
-            shared_ptr<Node> right);
-
-        CmdFuncCol searchCmdProducers;
-        shared_ptr<Node> root;
-        shared_ptr<Node> nextRoot;
-        weak_ptr<Node> bestLeaf;
-        shared_ptr<Node> totalBestLeaf;
-        weak_ptr<Node> unfinishedBestLeaf;
-        NodeWeakPtrList nextLeafs;
-        NodeWeakPtrList unfinishedLeafs;
+        // the root of the world without leafs
+        void resetRoot(const game::World &world);
+        // the cursors are at the root
+        const CmdBuffer &produceRootCmds();
+        // Rebuilds the subtree of nextRoot from the real world: the node
+        // commands are evaluated again level by level, invalid and seen
+        // states are dropped with their subtrees and the old leafs are
+        // moved to the new nodes. At the deadline the remaining nodes
+        // become leafs.
+        void salvage(const game::World &world, Clock::time_point deadline);
+        NodeIdx addNode(NodeData data, NodeIdx parent);
+        void moveCursor(Cursor &cursor, NodeIdx target, bool stepped) const;
+        // expand the current frontier level, return true on timeout or
+        // when over the budget
+        bool expandLevel(Clock::time_point deadline);
+        // the level is expanded in batches of this many leafs per thread,
+        // the expansions wait for the merge in a buffer of the batch size
+        static constexpr size_t PARALLEL_BATCH = 1024;
+        bool expandLevelParallel(Clock::time_point deadline);
+        // expands frontier nodes by priority, return true on timeout or
+        // when over the budget
+        bool expandBestFirst(Clock::time_point deadline);
+        static size_t nodeBytes(const Node &node)
+        {
+            return sizeof(Node) + node.data.delta.heapBytes() +
+                node.data.step.heapBytes();
+        }
+        size_t usedBytes() const
+        {
+            return treeBytes +
+                (unfinishedLeafs.size() + nextLeafs.size())*sizeof(Leaf) +
+                frontier.size()*sizeof(FrontierEntry);
+        }
+        bool overBudget() const
+        {
+            return nodes.size() >= maxNodes || usedBytes() >= maxTreeBytes;
+        }
+        // keeps the level leafs the budget has room for, the ones with
+        // the best parents
+        void trimLevel();
+        bool frontierEmpty() const
+        {
+            return unfinishedLeafs.empty() && frontier.empty();
+        }
+        // to the current level or the next one, or to the heap
+        void addLeaf(const Leaf &leaf, LeafList &levelLeafs);
+        bool dropLeaf(const Leaf &leaf) const;
+        // nothing below the node can beat the best finished state
+        bool pruneNode(const Criteria &bound) const;
+        // evaluates the leaf and produces its children, touches only the
+        // expansion and the cursor so it can run concurrently for
+        // different leafs; leaves the cursor at the stepped parent
+        void expandLeaf(const Leaf &leaf, Expansion &expansion,
+            Cursor &cursor);
+        // the cursor world is in the expanded state, it's restored
+        void produceChildren(Expansion &expansion, Cursor &cursor);
+        // adds the node of the expansion, NO_NODE if it's dropped
+        NodeIdx mergeNode(const Leaf &leaf, Expansion &expansion);
+        // the node and its children as leafs
+        void mergeLeaf(const Leaf &leaf, Expansion &expansion);
+        void printStats(Clock::time_point beginTime) const;
+        // moves the subtree of newRoot into the spare arena and drops the rest
+        void advanceRoot(NodeIdx newRoot);
+        NodeIdx bestResultNode(NodeIdx left, NodeIdx right) const;
+        // the child of the root on the path to the node, NO_NODE for the
+        // root
+        NodeIdx rootChild(NodeIdx node) const;
+        // the node with more alive points and then fewer enemies, the
+        // deeper one when both are equal, since the shots and the damage of
+        // a shallow node don't include what the later turns take
+        NodeIdx bestOrDeeperResultNode(NodeIdx left, NodeIdx right) const;
+
+        CmdProducer cmdProducer;
+        SearchOrder order;
+        bool boundPruning;
+        size_t maxNodes;
+        size_t maxTreeBytes;
+        bool salvageTree;
+        size_t stableLevels;
+        // of the nodes
+        size_t treeBytes;
+        size_t trimmedLeafs;
+        NodeArena nodes;
+        NodeArena spareNodes;
+        NodeIdxCol remap;
+        NodeIdx root;
+        NodeIdx nextRoot;
+        NodeIdx bestLeaf;
+        NodeIdx totalBestLeaf;
+        NodeIdx unfinishedBestLeaf;
+        LeafList nextLeafs;
+        LeafList unfinishedLeafs;
+        Frontier frontier;
+        FrontierEntryCol frontierEntries;
+        size_t frontierSeq;
         size_t depth;
-        ReducedStateSet seenStates;
+        TranspositionTable seenStates;
+        ExpansionCol expansions;
+        CounterCol threadEvals;
+        size_t prunedNodes;
+        // one per thread
+        CursorCol cursors;
+        LeafCol batch;
+        pool::WorkerPool workerPool;
+        thread ponderThread;
+        atomic<bool> stopSearch;
     };
 }
 
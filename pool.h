@@ -0,0 +1,100 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace pool
+{
+    using namespace std;
+
+    // Threads kept alive between the jobs. run calls the job with the
+    // thread index on every worker and with index 0 on the calling thread,
+    // and returns when all the calls are done.
+    class WorkerPool
+    {
+    public:
+        using Job = function<void(size_t)>;
+
+        // threads counts the calling thread
+        WorkerPool(size_t threads)
+            :m(), wake(), finished(), job(nullptr), generation(0), running(0),
+            stopping(false), workers()
+        {
+            for(size_t t = 1; t < threads; ++t)
+                workers.emplace_back([this, t]() { loop(t); });
+        }
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool &operator=(const WorkerPool&) = delete;
+
+        ~WorkerPool()
+        {
+            {
+                lock_guard<mutex> lock(m);
+                stopping = true;
+            }
+            wake.notify_all();
+            for(auto &w : workers)
+                w.join();
+        }
+
+        size_t size() const
+        {
+            return workers.size() + 1;
+        }
+
+        void run(const Job &newJob)
+        {
+            {
+                lock_guard<mutex> lock(m);
+                job = &newJob;
+                running = workers.size();
+                ++generation;
+            }
+            wake.notify_all();
+            newJob(0);
+            unique_lock<mutex> lock(m);
+            finished.wait(lock, [this]() { return running == 0; });
+            job = nullptr;
+        }
+
+    private:
+        void loop(size_t idx)
+        {
+            size_t seen = 0;
+            while(true)
+            {
+                const Job *current = nullptr;
+                {
+                    unique_lock<mutex> lock(m);
+                    wake.wait(lock, [this, seen]() {
+                        return stopping || generation != seen;
+                        });
+                    if(stopping)
+                        return;
+                    seen = generation;
+                    current = job;
+                }
+                (*current)(idx);
+                lock_guard<mutex> lock(m);
+                if(--running == 0)
+                    finished.notify_one();
+            }
+        }
+
+        mutex m;
+        condition_variable wake;
+        condition_variable finished;
+        const Job *job;
+        size_t generation;
+        size_t running;
+        bool stopping;
+        vector<thread> workers;
+    };
+}
+
+#endif
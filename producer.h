@@ -0,0 +1,158 @@
+#ifndef PRODUCER_H
+#define PRODUCER_H
+
+#include <cstddef>
+#include <vector>
+#include <tuple>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <new>
+#include <cassert>
+#include <iostream>
+
+#include "game.h"
+#include "analysis.h"
+
+namespace optimizer
+{
+    using namespace std;
+
+    using CmdCol = vector<game::Cmd>;
+
+    // Commands of one expansion in inline storage, the engines keep one
+    // and reuse it for every node.
+    class CmdBuffer
+    {
+    public:
+        static constexpr size_t CAPACITY = 32;
+
+        CmdBuffer()
+            :count(0)
+        {}
+
+        // a full buffer drops the command and returns false
+        bool push_back(const game::Cmd &cmd)
+        {
+            assert(count < CAPACITY);
+            if(count == CAPACITY)
+                return false;
+            new (&cmds[count++]) game::Cmd(cmd);
+            return true;
+        }
+
+        void clear()
+        {
+            count = 0;
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+
+        bool empty() const
+        {
+            return count == 0;
+        }
+
+        const game::Cmd &operator[](size_t idx) const
+        {
+            assert(idx < count);
+            return *reinterpret_cast<const game::Cmd*>(&cmds[idx]);
+        }
+
+        const game::Cmd *begin() const
+        {
+            return reinterpret_cast<const game::Cmd*>(cmds);
+        }
+
+        const game::Cmd *end() const
+        {
+            return begin() + count;
+        }
+
+    private:
+        static_assert(is_trivially_destructible<game::Cmd>::value,
+            "commands are dropped without destruction");
+        using Storage = typename aligned_storage<sizeof(game::Cmd),
+              alignof(game::Cmd)>::type;
+
+        size_t count;
+        Storage cmds[CAPACITY];
+    };
+
+    // What the engines call per expanded node: appends the commands of the
+    // state to the buffer.
+    using CmdProducer = function<void(const game::WorldEval&,
+        const game::Analysis&, CmdBuffer&)>;
+
+    // Producers returning their commands, for experiments. Every node pays
+    // for the calls and the vectors, the pipeline below avoids both.
+    using CmdFuncCol = vector<function<CmdCol(const game::WorldEval&,
+        const game::Analysis&)>>;
+
+    // Producers with a known type called in order. Each one is a function
+    // object with the CmdProducer signature, so the whole pipeline is
+    // compiled into a single call. The engines still hold it as a
+    // CmdProducer, that is one indirect call per expansion.
+    template<class... Producers>
+    class CmdPipeline
+    {
+    public:
+        CmdPipeline(Producers... producers)
+            :producers(move(producers)...)
+        {}
+
+        void operator()(const game::WorldEval &world,
+            const game::Analysis &analysis, CmdBuffer &out) const
+        {
+            produce<0>(world, analysis, out);
+        }
+
+    private:
+        template<size_t I>
+        typename enable_if<(I < sizeof...(Producers))>::type produce(
+            const game::WorldEval &world, const game::Analysis &analysis,
+            CmdBuffer &out) const
+        {
+            get<I>(producers)(world, analysis, out);
+            produce<I+1>(world, analysis, out);
+        }
+
+        template<size_t I>
+        typename enable_if<(I == sizeof...(Producers))>::type produce(
+            const game::WorldEval&, const game::Analysis&, CmdBuffer&) const
+        {}
+
+        tuple<Producers...> producers;
+    };
+
+    template<class... Producers>
+    CmdPipeline<Producers...> makeCmdPipeline(Producers... producers)
+    {
+        return CmdPipeline<Producers...>(move(producers)...);
+    }
+
+    // the dynamic producers behind the CmdProducer interface
+    inline CmdProducer makeCmdProducer(const CmdFuncCol &funcs)
+    {
+        return [funcs](const game::WorldEval &world,
+            const game::Analysis &analysis, CmdBuffer &out) {
+            for(const auto &f : funcs)
+            {
+                const auto cmds = f(world, analysis);
+                for(const auto &c : cmds)
+                {
+                    if(!out.push_back(c))
+                    {
+                        cerr<<"command buffer full, dropping commands"<<endl;
+                        return;
+                    }
+                }
+            }
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <iostream>
+
+#include "game.h"
+
+namespace
+{
+    bool countAllocs = false;
+    std::size_t allocs = 0;
+}
+
+void *operator new(std::size_t sz)
+{
+    if(countAllocs)
+        ++allocs;
+    if(void *p = std::malloc(sz != 0?sz:1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    // enemies reach the data points in a few turns and the player stays
+    // out of their way
+    game::World makeWorld()
+    {
+        game::DataPointCol points;
+        for(int i = 0; i < 6; ++i)
+        {
+            points.push_back(game::DataPoint{i,
+                geom::Point{4000+i*2000, 1000+(i%2)*1500}});
+        }
+        game::EnemyCol enemies;
+        for(int i = 0; i < 12; ++i)
+        {
+            enemies.push_back(game::Enemy{i, 10+i%4,
+                geom::Point{3500+i*1000, 3500+(i%3)*700}});
+        }
+        return game::World{game::Player{geom::Point{500, 8500}},
+            points, enemies};
+    }
+
+    std::vector<game::Cmd> makeCmds(const game::World &world)
+    {
+        std::vector<game::Cmd> res;
+        for(const auto &e : world.enemies)
+            res.push_back(game::Cmd::makeShootCmd(e.id));
+        for(int dx = -1; dx <= 1; ++dx)
+        {
+            for(int dy = -1; dy <= 1; ++dy)
+            {
+                res.push_back(game::Cmd::makeMoveCmd(geom::Point{
+                    world.player.pos.x + dx*1000,
+                    world.player.pos.y + dy*1000}));
+            }
+        }
+        return res;
+    }
+
+    // every eval variant from the base state, the work state and the
+    // delta reuse their storage
+    void evalAll(const game::WorldEval &base, game::WorldEval &work,
+        const std::vector<game::Cmd> &cmds, game::WorldEval::Delta &delta,
+        game::WorldEval::Step &step)
+    {
+        for(const auto &cmd : cmds)
+        {
+            work = base;
+            work.eval(cmd);
+            work = base;
+            work.eval(cmd, delta);
+            work.undo(delta);
+            work.apply(delta);
+            work = base;
+            work.step(step);
+            work.evalStepped(cmd, step, delta);
+            work.undo(delta);
+            work.undo(step);
+        }
+    }
+}
+
+int main()
+{
+    game::WorldEval base(makeWorld());
+    game::WorldEval work(base);
+    game::WorldEval::Delta delta;
+    game::WorldEval::Step step;
+    std::size_t turns = 0;
+    std::size_t failures = 0;
+    for(;; ++turns)
+    {
+        const auto &world = base.getWorld();
+        if(world.enemies.empty() || world.dataPoints.empty())
+            break;
+        const auto cmds = makeCmds(world);
+        evalAll(base, work, cmds, delta, step);
+        allocs = 0;
+        countAllocs = true;
+        evalAll(base, work, cmds, delta, step);
+        countAllocs = false;
+        if(allocs != 0)
+        {
+            std::cerr<<"turn "<<turns<<": "<<allocs<<" allocations"<<std::endl;
+            ++failures;
+        }
+        std::cerr<<"turn "<<turns<<": enemies="<<world.enemies.size()
+            <<" points="<<world.dataPoints.size()<<std::endl;
+        if(!base.eval(game::Cmd::makeShootCmd(world.enemies.front().id)))
+            break;
+    }
+    std::cerr<<"turns checked: "<<turns<<", failed: "<<failures<<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
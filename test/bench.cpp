@@ -1,4 +1,6 @@
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include "game.h"
@@ -34,7 +36,7 @@ namespace
         return res;
     }
 
-    void run()
+    void run(logic::EngineKind engineKind, std::size_t threads)
     {
         const std::size_t TRIALS = 100;
         for(std::size_t i = 1; i <= TRIALS; ++i)
@@ -45,7 +47,8 @@ namespace
                 makeDataPoints(20),
                 makeEnemies(30)
             });
-            logic::Logic logic;
+            logic::Logic logic(engineKind, false, logic::TimeConfig(),
+                threads);
 
             std::size_t depth = 1;
             for(;; ++depth)
@@ -74,7 +77,16 @@ namespace
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    run();
+    auto engineKind = logic::EngineKind::TREE;
+    if(argc > 1 && std::strcmp(argv[1], "beam") == 0)
+        engineKind = logic::EngineKind::BEAM;
+    else if(argc > 1 && std::strcmp(argv[1], "mcts") == 0)
+        engineKind = logic::EngineKind::MCTS;
+    else if(argc > 1 && std::strcmp(argv[1], "best-first") == 0)
+        engineKind = logic::EngineKind::BEST_FIRST;
+    // the tree engine expands the levels on this many threads
+    const std::size_t threads = (argc > 2?std::atoi(argv[2]):1);
+    run(engineKind, threads);
 }
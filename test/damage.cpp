@@ -0,0 +1,77 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "game.h"
+
+namespace
+{
+    int referenceDamage(std::int64_t dist2)
+    {
+        return std::round(125000.0/
+            std::pow(std::sqrt(static_cast<double>(dist2)), 1.2));
+    }
+}
+
+// compares calcDamage with the formula for every squared distance between
+// two points of the zone, the zero distance has no defined damage
+int main()
+{
+    const std::int64_t maxDist2 =
+        static_cast<std::int64_t>(game::ZONE.x)*game::ZONE.x +
+        static_cast<std::int64_t>(game::ZONE.y)*game::ZONE.y;
+    // bit set of the squared distances
+    std::vector<std::uint64_t> reachable(maxDist2/64+1, 0);
+    for(std::int64_t dx = 0; dx <= game::ZONE.x; ++dx)
+    {
+        for(std::int64_t dy = 0; dy <= game::ZONE.y; ++dy)
+        {
+            const auto dist2 = dx*dx + dy*dy;
+            reachable[dist2/64] |= std::uint64_t(1) << (dist2%64);
+        }
+    }
+    std::size_t checked = 0;
+    std::size_t failures = 0;
+    for(std::int64_t dist2 = 1; dist2 <= maxDist2; ++dist2)
+    {
+        if(!((reachable[dist2/64] >> (dist2%64)) & 1))
+            continue;
+        ++checked;
+        const auto expected = referenceDamage(dist2);
+        const auto actual = game::WorldEval::calcDamageDist2(dist2);
+        if(actual != expected)
+        {
+            if(failures < 10)
+            {
+                std::cerr<<"dist2="<<dist2<<": expected "<<expected
+                    <<", got "<<actual<<std::endl;
+            }
+            ++failures;
+        }
+    }
+    const geom::Point corners[] = {
+        geom::Point{0, 0}, geom::Point{game::ZONE.x, 0},
+        geom::Point{0, game::ZONE.y}, game::ZONE};
+    for(const auto &a : corners)
+    {
+        for(const auto &b : corners)
+        {
+            if(a == b)
+                continue;
+            const auto expected = static_cast<int>(std::round(125000.0/
+                    std::pow(geom::dist(a, b), 1.2)));
+            if(game::WorldEval::calcDamage(a, b) != expected)
+            {
+                std::cerr<<"corners "<<a<<' '<<b<<": expected "<<expected
+                    <<std::endl;
+                ++failures;
+            }
+        }
+    }
+    std::cerr<<"squared distances checked: "<<checked<<", failed: "
+        <<failures<<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
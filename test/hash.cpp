@@ -0,0 +1,142 @@
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "game.h"
+
+namespace
+{
+    // the incremental hashes match the ones of a world built from scratch
+    bool sameHashes(const game::WorldEval &world)
+    {
+        // a world without data points is finished and can't be built
+        if(world.getWorld().dataPoints.empty())
+            return true;
+        const game::WorldEval fresh(world.getWorld());
+        return fresh.hash() == world.hash() &&
+            fresh.getEnemyIdsHash() == world.getEnemyIdsHash() &&
+            fresh.getDataPointIdsHash() == world.getDataPointIdsHash();
+    }
+
+    // weak enemies close to the points, so the games have kills and
+    // captures
+    game::World makeWorld(std::mt19937 &random)
+    {
+        std::uniform_int_distribution<int> x(0, game::ZONE.x);
+        std::uniform_int_distribution<int> y(0, game::ZONE.y);
+        std::uniform_int_distribution<int> life(1, 15);
+        game::World world{game::Player{geom::Point{x(random), y(random)}},
+            game::DataPointCol(), game::EnemyCol()};
+        const auto points = std::uniform_int_distribution<int>(1, 5)(random);
+        for(int i = 0; i < points; ++i)
+        {
+            world.dataPoints.push_back(
+                game::DataPoint{i*2, geom::Point{x(random), y(random)}});
+        }
+        const auto enemies = std::uniform_int_distribution<int>(1, 8)(random);
+        for(int i = 0; i < enemies; ++i)
+        {
+            world.enemies.push_back(
+                game::Enemy{i*3, life(random), geom::Point{x(random), y(random)}});
+        }
+        return world;
+    }
+
+    game::Cmd makeCmd(const game::World &world, std::mt19937 &random)
+    {
+        if(random()%2 == 0)
+        {
+            const auto &e = world.enemies[random()%world.enemies.size()];
+            return game::Cmd::makeShootCmd(e.id);
+        }
+        return game::Cmd::makeMoveCmd(geom::Point{
+            std::uniform_int_distribution<int>(0, game::ZONE.x)(random),
+            std::uniform_int_distribution<int>(0, game::ZONE.y)(random)});
+    }
+}
+
+// plays random games and checks the hashes after every eval, apply, undo
+// and snapshot restore
+int main()
+{
+    const std::size_t GAMES = 300;
+    std::mt19937 random(5);
+    std::size_t checked = 0;
+    std::size_t failures = 0;
+    const auto check = [&checked, &failures](const game::WorldEval &world,
+        const char *path) {
+        ++checked;
+        if(!sameHashes(world))
+        {
+            std::cerr<<path<<" hash differs"<<std::endl;
+            ++failures;
+        }
+    };
+    for(std::size_t g = 0; g < GAMES; ++g)
+    {
+        game::WorldEval world(makeWorld(random));
+        for(std::size_t turn = 0; turn < 30; ++turn)
+        {
+            const auto &w = world.getWorld();
+            if(w.enemies.empty() || w.dataPoints.empty())
+                break;
+            const auto cmd = makeCmd(w, random);
+            const auto before = world;
+
+            game::WorldEval::Delta delta;
+            auto byDelta = before;
+            byDelta.eval(cmd, delta);
+            check(byDelta, "delta eval");
+            byDelta.undo(delta);
+            check(byDelta, "delta undo");
+            byDelta.apply(delta);
+            check(byDelta, "delta apply");
+
+            game::WorldEval::Step step;
+            game::WorldEval::Delta steppedDelta;
+            auto byStep = before;
+            byStep.step(step);
+            check(byStep, "step");
+            byStep.evalStepped(cmd, step, steppedDelta);
+            check(byStep, "stepped eval");
+            byStep.undo(steppedDelta);
+            byStep.undo(step);
+            check(byStep, "stepped undo");
+            if(byStep.hash() != before.hash() ||
+                byStep.getEnemyIdsHash() != before.getEnemyIdsHash() ||
+                byStep.getDataPointIdsHash() != before.getDataPointIdsHash())
+            {
+                std::cerr<<"stepped undo hash changed"<<std::endl;
+                ++failures;
+            }
+            byStep.apply(step);
+            byStep.apply(steppedDelta);
+            check(byStep, "stepped apply");
+
+            // a snapshot of the stepped state restored into the world before
+            const game::WorldSnapshot<8, 5> snapshot(byStep);
+            auto restored = before;
+            restored.restore(snapshot);
+            check(restored, "snapshot restore");
+            if(restored.hash() != byStep.hash())
+            {
+                std::cerr<<"snapshot hash differs"<<std::endl;
+                ++failures;
+            }
+
+            const auto alive = world.eval(cmd);
+            check(world, "eval");
+            if(world.getWorld() != before.getWorld() &&
+                world.hash() == before.hash())
+            {
+                std::cerr<<"hash unchanged by eval"<<std::endl;
+                ++failures;
+            }
+            if(!alive)
+                break;
+        }
+    }
+    std::cerr<<"hashes checked: "<<checked<<", failed: "<<failures<<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
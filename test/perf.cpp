@@ -1,4 +1,6 @@
 #include <chrono>
+#include <cstddef>
+#include <cstdlib>
 #include <iostream>
 
 #include "optimizer.h"
@@ -8,7 +10,7 @@
 
 namespace
 {
-    void perf()
+    void perf(std::size_t threads)
     {
         const game::World world{
             game::Player{
@@ -75,7 +77,9 @@ namespace
                 }
             }
         };
-        optimizer::Optimizer optimizer(logic::Logic::searchFuncs);
+        optimizer::OptimizerConfig config;
+        config.threads = threads;
+        optimizer::Optimizer optimizer(logic::Logic::searchProducer, config);
         const auto r = optimizer.optimize(world, std::chrono::milliseconds(1000000));
         if(r.second)
         {
@@ -97,7 +101,8 @@ namespace
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
-    perf();
+    const std::size_t threads = (argc > 1?std::atoi(argv[1]):1);
+    perf(threads);
 }
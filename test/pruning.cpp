@@ -0,0 +1,79 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+#include "optimizer.h"
+#include "geom.h"
+#include "game.h"
+#include "logic.h"
+
+namespace
+{
+    // few enemies and points, so the full tree is built in a moment
+    game::World makeWorld(std::mt19937 &random)
+    {
+        std::uniform_int_distribution<int> x(0, game::ZONE.x);
+        std::uniform_int_distribution<int> y(0, game::ZONE.y);
+        std::uniform_int_distribution<int> life(1, 12);
+        game::World world{game::Player{geom::Point{x(random), y(random)}},
+            game::DataPointCol(), game::EnemyCol()};
+        const auto points = std::uniform_int_distribution<int>(1, 3)(random);
+        for(int i = 0; i < points; ++i)
+        {
+            world.dataPoints.push_back(
+                game::DataPoint{i, geom::Point{x(random), y(random)}});
+        }
+        const auto enemies = std::uniform_int_distribution<int>(1, 4)(random);
+        for(int i = 0; i < enemies; ++i)
+        {
+            world.enemies.push_back(
+                game::Enemy{i, life(random), geom::Point{x(random), y(random)}});
+        }
+        return world;
+    }
+
+    std::pair<optimizer::Criteria, bool> searchFullTree(
+        const game::World &world, bool boundPruning)
+    {
+        optimizer::OptimizerConfig config;
+        config.boundPruning = boundPruning;
+        optimizer::Optimizer optimizer(logic::Logic::searchProducer, config);
+        // the search ends when the tree is built
+        optimizer.optimize(world, std::chrono::milliseconds(60000));
+        return optimizer.bestCriteria();
+    }
+
+    bool sameCriteria(const optimizer::Criteria &left,
+        const optimizer::Criteria &right)
+    {
+        return !(left < right) && !(right < left);
+    }
+}
+
+// The criteria bound prunes only nodes that can't beat the best finished
+// state, so the full tree search finds the same best criteria with the
+// pruning as without it.
+int main()
+{
+    const std::size_t SCENARIOS = 30;
+    std::mt19937 random(7);
+    std::size_t failures = 0;
+    for(std::size_t i = 0; i < SCENARIOS; ++i)
+    {
+        const auto world = makeWorld(random);
+        const auto full = searchFullTree(world, false);
+        const auto pruned = searchFullTree(world, true);
+        if(full.second != pruned.second ||
+            (full.second && !sameCriteria(full.first, pruned.first)))
+        {
+            std::cerr<<"scenario "<<i<<": without pruning "<<full.first
+                <<", with pruning "<<pruned.first<<std::endl;
+            ++failures;
+        }
+    }
+    std::cerr<<"pruning scenarios checked: "<<SCENARIOS<<", failed: "
+        <<failures<<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
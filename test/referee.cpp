@@ -0,0 +1,278 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "game.h"
+#include "lanes.h"
+
+namespace
+{
+    // floor(d*step/sqrt(dist2)) == q in integers, the rules round the moved
+    // coordinates down
+    bool isFloorStep(std::int64_t q, std::int64_t d, std::int64_t dist2,
+        std::int64_t step)
+    {
+        const auto scaled = d*d*step*step;
+        if(d >= 0)
+            return q >= 0 && q*q*dist2 <= scaled && (q+1)*(q+1)*dist2 > scaled;
+        const auto m = -q;
+        return m >= 1 && m*m*dist2 >= scaled && (m-1)*(m-1)*dist2 < scaled;
+    }
+
+    // Moves over every displacement of the zone towards the zone corners,
+    // so the coordinates stay positive. The x and y steps depend only on
+    // their own sign, so two quadrants cover all of them. The enemies move
+    // with the kernels, the player with the geom functions.
+    std::size_t checkMoves(bool enemies, std::size_t &checked)
+    {
+        const int step = (enemies?game::ENEMY_STEP_DIST:game::PLAYER_STEP_DIST);
+        std::size_t failures = 0;
+        std::vector<int> x, y, targetX, targetY;
+        std::vector<unsigned char> reached;
+        for(const int sign : {1, -1})
+        {
+            const geom::Point from = (sign > 0?geom::Point{0, 0}:game::ZONE);
+            for(int dx = 0; dx <= game::ZONE.x; ++dx)
+            {
+                x.assign(game::ZONE.y+1, from.x);
+                y.assign(game::ZONE.y+1, from.y);
+                targetX.assign(game::ZONE.y+1, from.x + sign*dx);
+                targetY.clear();
+                for(int dy = 0; dy <= game::ZONE.y; ++dy)
+                    targetY.push_back(from.y + sign*dy);
+                reached.assign(x.size(), 0);
+                if(enemies)
+                {
+                    game::lanes::moveTowards(x.data(), y.data(),
+                        targetX.data(), targetY.data(), x.size(), step,
+                        reached.data());
+                }
+                for(int dy = 0; dy <= game::ZONE.y; ++dy)
+                {
+                    const geom::Point target{targetX[dy], targetY[dy]};
+                    const std::int64_t dist2 = geom::dist2(from, target);
+                    // the enemies arrive within the truncated step, the
+                    // player within the exact one
+                    const bool arrives = (enemies
+                        ?geom::withinTruncatedDist(from, target, step)
+                        :geom::withinDist(from, target, step));
+                    const geom::Point moved = (enemies
+                        ?geom::Point{x[dy], y[dy]}
+                        :geom::add(from, geom::mult(
+                                geom::normDirection(from, target), step)));
+                    bool ok = true;
+                    if(enemies)
+                    {
+                        ok = (reached[dy] != 0) == arrives &&
+                            (!arrives || moved == target);
+                    }
+                    if(!arrives)
+                    {
+                        ++checked;
+                        ok = ok &&
+                            isFloorStep(moved.x - from.x, sign*dx, dist2, step) &&
+                            isFloorStep(moved.y - from.y, sign*dy, dist2, step);
+                    }
+                    if(!ok)
+                    {
+                        if(failures < 10)
+                        {
+                            std::cerr<<(enemies?"enemy ":"player ")<<from
+                                <<"->"<<target<<": "<<moved<<std::endl;
+                        }
+                        ++failures;
+                    }
+                }
+            }
+        }
+        return failures;
+    }
+
+    struct Turn
+    {
+        game::Cmd cmd;
+        // the player survives the turn
+        bool alive;
+        game::World expected;
+    };
+
+    struct Trace
+    {
+        const char *name;
+        game::World start;
+        std::vector<Turn> turns;
+    };
+
+    // Turns worked out by hand from the rules: the enemies move 500 towards
+    // their data point, the player moves 1000 towards the target, he dies
+    // with an enemy within 2000, then shoots for round(125000/d^1.2) and
+    // the surviving enemies collect their points. The coordinates are
+    // rounded down.
+    std::vector<Trace> makeTraces()
+    {
+        using game::Cmd;
+        using game::World;
+        using geom::Point;
+        const game::DataPointCol farPoint{{0, Point{8000, 0}}};
+        const game::DataPointCol twoPoints{
+            {0, Point{1000, 1000}}, {1, Point{9000, 1000}}};
+        return std::vector<Trace>{
+            Trace{"diagonal move is rounded down",
+                World{{Point{0, 0}}, farPoint, {{0, 5, Point{8000, 8000}}}},
+                {
+                    // 1000/sqrt(2) = 707.1
+                    Turn{Cmd::makeMoveCmd(Point{1000, 1000}), true,
+                        World{{Point{707, 707}}, farPoint,
+                            {{0, 5, Point{8000, 7500}}}}},
+                    // 293 and 1293 from (1000, 2000), 1000/1325.8 = 0.754
+                    Turn{Cmd::makeMoveCmd(Point{1000, 2000}), true,
+                        World{{Point{928, 1682}}, farPoint,
+                            {{0, 5, Point{8000, 7000}}}}}
+                }},
+            Trace{"exact steps",
+                World{{Point{0, 0}}, farPoint, {{0, 5, Point{8000, 8000}}}},
+                {
+                    // the 3-4-5 direction has an integer step
+                    Turn{Cmd::makeMoveCmd(Point{3000, 4000}), true,
+                        World{{Point{600, 800}}, farPoint,
+                            {{0, 5, Point{8000, 7500}}}}},
+                    // exactly 1000 away, the target is reached
+                    Turn{Cmd::makeMoveCmd(Point{1200, 1600}), true,
+                        World{{Point{1200, 1600}}, farPoint,
+                            {{0, 5, Point{8000, 7000}}}}}
+                }},
+            Trace{"enemy collects its point",
+                World{{Point{0, 8000}}, twoPoints,
+                    {{0, 5, Point{1000, 1300}}, {1, 5, Point{9000, 1700}}}},
+                {
+                    // enemy 1 stops 200 short, enemy 0 arrives
+                    Turn{Cmd::makeMoveCmd(Point{0, 8000}), true,
+                        World{{Point{0, 8000}}, {{1, Point{9000, 1000}}},
+                            {{0, 5, Point{1000, 1000}},
+                                {1, 5, Point{9000, 1200}}}}},
+                    // enemy 0 heads to the last point, enemy 1 collects it
+                    Turn{Cmd::makeMoveCmd(Point{0, 8000}), true,
+                        World{{Point{0, 8000}}, {},
+                            {{0, 5, Point{1500, 1000}},
+                                {1, 5, Point{9000, 1000}}}}}
+                }},
+            Trace{"arrival within a step rounded down",
+                World{{Point{0, 8000}}, {{0, Point{3000, 3000}}},
+                    {{0, 5, Point{2500, 3010}}}},
+                {
+                    // 500.1 away
+                    Turn{Cmd::makeMoveCmd(Point{0, 8000}), true,
+                        World{{Point{0, 8000}}, {},
+                            {{0, 5, Point{3000, 3000}}}}}
+                }},
+            Trace{"shots",
+                World{{Point{0, 0}}, {{0, Point{0, 9000}}},
+                    {{0, 20, Point{0, 3000}}}},
+                {
+                    // 7 damage at 3500
+                    Turn{Cmd::makeShootCmd(0), true,
+                        World{{Point{0, 0}}, {{0, Point{0, 9000}}},
+                            {{0, 13, Point{0, 3500}}}}},
+                    // 6 damage at 4000
+                    Turn{Cmd::makeShootCmd(0), true,
+                        World{{Point{0, 0}}, {{0, Point{0, 9000}}},
+                            {{0, 7, Point{0, 4000}}}}}
+                }},
+            Trace{"killed enemy doesn't collect",
+                World{{Point{1000, 4500}}, twoPoints,
+                    {{0, 3, Point{1000, 1300}}}},
+                {
+                    // 7 damage at 3500 after the enemy arrives
+                    Turn{Cmd::makeShootCmd(0), true,
+                        World{{Point{1000, 4500}}, twoPoints, {}}}
+                }},
+            Trace{"death before the shot",
+                World{{Point{0, 300}}, {{0, Point{0, 0}}},
+                    {{0, 1, Point{0, 2400}}}},
+                {
+                    Turn{Cmd::makeShootCmd(0), false, World()}
+                }},
+            Trace{"death at the death distance",
+                World{{Point{0, 0}}, {{0, Point{0, 1000}}},
+                    {{0, 5, Point{0, 2500}}}},
+                {
+                    Turn{Cmd::makeMoveCmd(Point{0, 0}), false, World()}
+                }}
+        };
+    }
+
+    // the turns through eval, the delta and the step with undo and apply
+    std::size_t checkTrace(const Trace &trace)
+    {
+        std::size_t failures = 0;
+        game::WorldEval world(trace.start);
+        game::WorldEval::Delta delta;
+        game::WorldEval::Step step;
+        for(std::size_t t = 0; t < trace.turns.size(); ++t)
+        {
+            const auto &turn = trace.turns[t];
+            const auto report = [&trace, t, &failures](const char *path) {
+                std::cerr<<trace.name<<", turn "<<t<<": "<<path
+                    <<" differs"<<std::endl;
+                ++failures;
+            };
+            auto byDelta = world;
+            const auto deltaAlive = byDelta.eval(turn.cmd, delta);
+            auto byStep = world;
+            byStep.step(step);
+            const auto stepAlive = byStep.evalStepped(turn.cmd, step);
+            const auto before = world.getWorld();
+            const auto alive = world.eval(turn.cmd);
+            if(alive != turn.alive || deltaAlive != turn.alive ||
+                stepAlive != turn.alive)
+            {
+                report("survival");
+                break;
+            }
+            if(!alive)
+                break;
+            if(world.getWorld() != turn.expected)
+            {
+                report("eval");
+                const auto &w = world.getWorld();
+                std::cerr<<"  player "<<w.player.pos;
+                for(const auto &e : w.enemies)
+                    std::cerr<<", "<<e;
+                for(const auto &p : w.dataPoints)
+                    std::cerr<<", "<<p;
+                std::cerr<<std::endl;
+            }
+            if(byDelta.getWorld() != turn.expected)
+                report("delta eval");
+            byDelta.undo(delta);
+            if(byDelta.getWorld() != before)
+                report("delta undo");
+            byDelta.apply(delta);
+            if(byDelta.getWorld() != turn.expected)
+                report("delta apply");
+            if(byStep.getWorld() != turn.expected)
+                report("stepped eval");
+        }
+        return failures;
+    }
+}
+
+// Checks the simulation against the rules. No recorded referee games are
+// available, so the traces are derived by hand; the move arithmetic is
+// compared with exact integer rounding over the whole zone.
+int main()
+{
+    std::size_t failures = 0;
+    std::size_t moves = 0;
+    failures += checkMoves(true, moves);
+    failures += checkMoves(false, moves);
+    const auto traces = makeTraces();
+    for(const auto &trace : traces)
+        failures += checkTrace(trace);
+    std::cerr<<"moves checked: "<<moves<<", traces checked: "<<traces.size()
+        <<", failed: "<<failures<<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
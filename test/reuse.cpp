@@ -0,0 +1,139 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "arena.h"
+#include "optimizer.h"
+#include "mcts.h"
+#include "game.h"
+#include "logic.h"
+
+namespace
+{
+    struct Node
+    {
+        std::size_t parent;
+        std::size_t firstChild;
+        std::size_t lastChild;
+        std::size_t nextSibling;
+    };
+    using NodeArena = arena::Arena<Node, 16>;
+
+    std::size_t failures = 0;
+
+    void expect(bool ok, const char *what)
+    {
+        if(!ok)
+        {
+            std::cerr<<what<<std::endl;
+            ++failures;
+        }
+    }
+
+    // nodes reached by the child links
+    std::size_t countLinked(const NodeArena &nodes, std::size_t idx)
+    {
+        std::size_t res = 1;
+        for(auto c = nodes[idx].firstChild; c != arena::NO_IDX;
+            c = nodes[c].nextSibling)
+        {
+            res += countLinked(nodes, c);
+        }
+        return res;
+    }
+
+    // Compacts a random tree to a child of the root and then to a child of
+    // that one. Every node below the new root has to stay linked.
+    void checkCompaction()
+    {
+        std::mt19937 random(3);
+        NodeArena nodes;
+        NodeArena spare;
+        nodes.emplace(Node{arena::NO_IDX, arena::NO_IDX, arena::NO_IDX,
+                arena::NO_IDX});
+        for(std::size_t i = 0; nodes.size() < 2000; ++i)
+        {
+            const auto children = 1 + random()%4;
+            for(std::size_t c = 0; c < children; ++c)
+            {
+                const auto idx = nodes.emplace(Node{i, arena::NO_IDX,
+                    arena::NO_IDX, arena::NO_IDX});
+                arena::appendChild(nodes, i, idx);
+            }
+        }
+        std::vector<std::size_t> remap;
+        for(std::size_t advance = 0; advance < 2; ++advance)
+        {
+            const auto newRoot = nodes[nodes[0].firstChild].nextSibling;
+            const auto expected = countLinked(nodes, newRoot);
+            arena::compactTree(nodes, spare, newRoot, remap);
+            expect(nodes.size() == expected, "compacted tree size differs");
+            expect(countLinked(nodes, 0) == expected,
+                "compacted tree lost child links");
+            for(std::size_t i = 1; i < nodes.size(); ++i)
+            {
+                const auto parent = nodes[i].parent;
+                expect(parent < i, "parent after its child");
+                if(parent >= i)
+                    break;
+            }
+        }
+    }
+
+    game::World makeWorld()
+    {
+        return game::World{
+            game::Player{geom::Point{8000, 4500}},
+            game::DataPointCol{
+                game::DataPoint{0, geom::Point{200, 1000}},
+                game::DataPoint{1, geom::Point{14000, 8000}}
+            },
+            game::EnemyCol{
+                game::Enemy{0, 10, geom::Point{12000, 1000}},
+                game::Enemy{1, 10, geom::Point{3000, 4536}},
+                game::Enemy{2, 10, geom::Point{11111, 7536}},
+                game::Enemy{3, 10, geom::Point{4000, 7600}}
+            }
+        };
+    }
+
+    // Plays two searched turns and a third one without time, so the tree
+    // of the third turn is only what the two root advances kept.
+    template<class Engine, class Check>
+    void checkReuse(Engine &engine, const Check &check)
+    {
+        game::WorldEval world(makeWorld());
+        for(std::size_t turn = 0; turn < 3; ++turn)
+        {
+            const auto limit = std::chrono::milliseconds(turn < 2?50:0);
+            const auto res = engine.optimize(world.getWorld(), limit);
+            if(turn == 2)
+                break;
+            expect(res.second, "no result");
+            if(!res.second || !world.eval(res.first))
+                return;
+        }
+        check(engine);
+    }
+}
+
+int main()
+{
+    checkCompaction();
+    optimizer::Optimizer tree(logic::Logic::searchProducer);
+    checkReuse(tree, [](const optimizer::Optimizer &o) {
+        expect(o.nodeCount() > 100, "optimizer tree isn't reused");
+        expect(o.leafCount() > 100, "optimizer leafs aren't reused");
+        expect(o.bestCriteria().second, "optimizer result isn't reused");
+    });
+    optimizer::MctsOptimizer mcts(logic::Logic::searchProducer);
+    checkReuse(mcts, [](const optimizer::MctsOptimizer &o) {
+        expect(o.nodeCount() > 100, "mcts tree isn't reused");
+        expect(o.rootVisits() > 100, "mcts visits aren't reused");
+    });
+    std::cerr<<"tree reuse checks failed: "<<failures<<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
@@ -0,0 +1,136 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "optimizer.h"
+#include "geom.h"
+#include "game.h"
+#include "logic.h"
+
+namespace
+{
+    using Perturb = std::function<bool(game::World&, std::size_t)>;
+
+    const std::chrono::milliseconds TURN_LIMIT(60);
+
+    game::World makeWorld()
+    {
+        return game::World{
+            game::Player{geom::Point{8000, 4500}},
+            game::DataPointCol{
+                game::DataPoint{0, geom::Point{200, 1000}},
+                game::DataPoint{1, geom::Point{1099, 300}},
+                game::DataPoint{2, geom::Point{14000, 8000}}
+            },
+            game::EnemyCol{
+                game::Enemy{0, 3, geom::Point{12000, 1000}},
+                game::Enemy{1, 2, geom::Point{3000, 4536}},
+                game::Enemy{2, 9, geom::Point{11111, 5536}},
+                game::Enemy{3, 2, geom::Point{4000, 7600}},
+                game::Enemy{4, 8, geom::Point{11999, 8000}},
+                game::Enemy{5, 5, geom::Point{13999, 2404}}
+            }
+        };
+    }
+
+    // the command is one the referee would accept in the world
+    bool validCmd(const game::World &world, const game::Cmd &cmd)
+    {
+        if(cmd.getType() == game::Cmd::TYPE_MOVE)
+            return true;
+        for(const auto &e : world.enemies)
+        {
+            if(e.id == cmd.getShootId())
+                return true;
+        }
+        return false;
+    }
+
+    // Plays a turn, perturbs the predicted world at the enemy and plays the
+    // next two turns from it, so the tree is salvaged once.
+    std::size_t check(const char *name, const Perturb &perturb,
+        std::size_t enemy)
+    {
+        optimizer::Optimizer optimizer(logic::Logic::searchProducer);
+        game::WorldEval world(makeWorld());
+        const auto first = optimizer.optimize(world.getWorld(), TURN_LIMIT);
+        if(!first.second || !world.eval(first.first))
+            return 0;
+        auto next = world.getWorld();
+        if(!perturb(next, enemy))
+            return 0;
+        std::size_t failures = 0;
+        game::WorldEval perturbed(next);
+        for(std::size_t turn = 0; turn < 2; ++turn)
+        {
+            const auto res = optimizer.optimize(perturbed.getWorld(),
+                TURN_LIMIT);
+            if(!res.second)
+                break;
+            if(!validCmd(perturbed.getWorld(), res.first))
+            {
+                std::cerr<<name<<", enemy "<<enemy<<", turn "<<turn
+                    <<": invalid command"<<std::endl;
+                ++failures;
+                break;
+            }
+            if(!perturbed.eval(res.first) ||
+                perturbed.getWorld().enemies.empty() ||
+                perturbed.getWorld().dataPoints.empty())
+            {
+                break;
+            }
+        }
+        return failures;
+    }
+}
+
+// The optimizer salvages its tree when the world differs from the predicted
+// one, the commands of the old tree must not be applied where they aren't
+// valid any more.
+int main()
+{
+    const std::vector<std::pair<const char*, Perturb>> perturbs{
+        {"killed", [](game::World &w, std::size_t i) {
+            if(i >= w.enemies.size() || w.enemies.size() < 2)
+                return false;
+            w.enemies.erase(w.enemies.begin() + i);
+            return true;
+        }},
+        {"damaged", [](game::World &w, std::size_t i) {
+            if(i >= w.enemies.size() || w.enemies[i].life < 2)
+                return false;
+            w.enemies[i].life -= 1;
+            return true;
+        }},
+        {"shifted", [](game::World &w, std::size_t i) {
+            if(i >= w.enemies.size())
+                return false;
+            w.enemies[i].pos.x += (w.enemies[i].pos.x > 0?-1:1);
+            return true;
+        }},
+        {"repeated", [](game::World &w, std::size_t i) {
+            if(i > 0)
+                return false;
+            w = makeWorld();
+            return true;
+        }}
+    };
+    std::size_t failures = 0;
+    std::size_t checked = 0;
+    const auto enemies = makeWorld().enemies.size();
+    for(const auto &p : perturbs)
+    {
+        for(std::size_t i = 0; i < enemies; ++i)
+        {
+            failures += check(p.first, p.second, i);
+            ++checked;
+        }
+    }
+    std::cerr<<"salvage cases checked: "<<checked<<", failed: "<<failures
+        <<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "game.h"
+#include "timemanager.h"
+
+namespace
+{
+    using std::chrono::milliseconds;
+
+    std::size_t failures = 0;
+
+    void expect(bool ok, const char *what, milliseconds budget)
+    {
+        if(!ok)
+        {
+            std::cerr<<what<<": budget "<<budget.count()<<"ms"<<std::endl;
+            ++failures;
+        }
+    }
+
+    // a turn with the given time after the search, returns the budget
+    milliseconds playTurn(logic::TimeManager &timeManager, milliseconds after)
+    {
+        timeManager.startTurn();
+        const auto budget = timeManager.beginSearch();
+        timeManager.endSearch();
+        std::this_thread::sleep_for(after);
+        timeManager.endTurn();
+        return budget;
+    }
+}
+
+// The budgets only shrink with the delays of a loaded machine, the checks
+// of the lower bounds leave room for them.
+int main()
+{
+    logic::TimeConfig config;
+    config.turnLimit = milliseconds(100);
+    config.firstTurnLimit = milliseconds(1000);
+    config.safetyMargin = milliseconds(5);
+    config.initialOverhead = milliseconds(2);
+    config.minSearch = milliseconds(1);
+    logic::TimeManager timeManager(config);
+
+    // the first turn has the longer limit, the margin scaled with it and
+    // the initial overhead
+    const auto first = playTurn(timeManager, milliseconds(0));
+    expect(first <= milliseconds(1000-50-2) && first >= milliseconds(900),
+        "first turn", first);
+    const auto second = playTurn(timeManager, milliseconds(20));
+    expect(second <= milliseconds(100-5) && second >= milliseconds(60),
+        "second turn", second);
+    // the 20ms after the search are taken from the next budget at once
+    const auto slow = playTurn(timeManager, milliseconds(0));
+    expect(slow <= milliseconds(100-5-20), "after a slow turn", slow);
+    // and given back slowly
+    milliseconds recovered(0);
+    for(std::size_t i = 0; i < 20; ++i)
+        recovered = playTurn(timeManager, milliseconds(0));
+    expect(recovered > slow && recovered >= milliseconds(80),
+        "after fast turns", recovered);
+    const auto afterFast = playTurn(timeManager, milliseconds(0));
+
+    // a search past its budget counts as overhead
+    timeManager.startTurn();
+    const auto overrunBudget = timeManager.beginSearch();
+    std::this_thread::sleep_for(overrunBudget + milliseconds(20));
+    timeManager.endSearch();
+    timeManager.endTurn();
+    const auto afterOverrun = playTurn(timeManager, milliseconds(0));
+    expect(afterOverrun + milliseconds(20) <= afterFast, "after an overrun",
+        afterOverrun);
+
+    // the time before the search is taken from the budget, but the search
+    // keeps its minimum
+    timeManager.startTurn();
+    std::this_thread::sleep_for(milliseconds(150));
+    const auto late = timeManager.beginSearch();
+    timeManager.endSearch();
+    timeManager.endTurn();
+    expect(late == config.minSearch, "late search", late);
+
+    // turn marks without a search don't use up the first turn
+    logic::TimeManager marksOnly(config);
+    marksOnly.startTurn();
+    marksOnly.endTurn();
+    marksOnly.startTurn();
+    const auto afterMarks = marksOnly.beginSearch();
+    marksOnly.endSearch();
+    marksOnly.endTurn();
+    expect(afterMarks > milliseconds(100), "first search after marks",
+        afterMarks);
+
+    // the defaults give the first turn no longer limit
+    logic::TimeManager defaults;
+    const auto defaultFirst = defaults.beginSearch();
+    defaults.endSearch();
+    expect(defaultFirst <= game::TIME_LIMIT, "default first turn",
+        defaultFirst);
+
+    // without the turn marks every search is a turn of its own
+    logic::TimeManager unmarked(config);
+    const auto unmarkedFirst = unmarked.beginSearch();
+    unmarked.endSearch();
+    const auto unmarkedSecond = unmarked.beginSearch();
+    unmarked.endSearch();
+    expect(unmarkedFirst > milliseconds(100), "unmarked first turn",
+        unmarkedFirst);
+    expect(unmarkedSecond <= milliseconds(100-5-2), "unmarked second turn",
+        unmarkedSecond);
+
+    std::cerr<<"time manager checks failed: "<<failures<<std::endl;
+    return failures == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
@@ -0,0 +1,77 @@
+#include "timemanager.h"
+
+#include <iostream>
+#include <algorithm>
+
+namespace logic
+{
+    TimeManager::TimeManager(const TimeConfig &config)
+        :config(config), turn(0), searches(0), turnStarted(false),
+        searched(false),
+        turnBegin(), searchBegin(), searchEnd(),
+        searchLimit(chrono::milliseconds::zero()),
+        overhead(config.initialOverhead)
+    {}
+
+    void TimeManager::startTurn()
+    {
+        // a turn without the output mark doesn't measure the overhead
+        if(turnStarted)
+            ++turn;
+        turnStarted = true;
+        searched = false;
+        turnBegin = Clock::now();
+    }
+
+    chrono::milliseconds TimeManager::beginSearch()
+    {
+        if(!turnStarted || searched)
+            startTurn();
+        searchBegin = Clock::now();
+        const auto left = turnLimit() - safetyMargin() -
+            chrono::duration_cast<chrono::milliseconds>(
+                overhead + (searchBegin - turnBegin));
+        searchLimit = max(left, config.minSearch);
+        return searchLimit;
+    }
+
+    void TimeManager::endSearch()
+    {
+        searched = true;
+        ++searches;
+        searchEnd = Clock::now();
+    }
+
+    void TimeManager::endTurn()
+    {
+        if(!turnStarted || !searched)
+            return;
+        const auto now = Clock::now();
+        // the time before the search is taken from the budget directly
+        const auto overrun = max<Clock::duration>(
+            searchEnd - searchBegin - searchLimit, Clock::duration::zero());
+        const auto sample = (now - searchEnd) + overrun;
+        overhead = max(sample, overhead - (overhead - sample)/4);
+        const auto total = chrono::duration_cast<chrono::milliseconds>(
+            now - turnBegin);
+        cerr<<"turn time: turn="<<turn<<" total="<<total.count()
+            <<" limit="<<turnLimit().count()<<" overhead="
+            <<chrono::duration_cast<chrono::microseconds>(overhead).count()
+            <<"us"<<endl;
+        ++turn;
+        turnStarted = false;
+    }
+
+    chrono::milliseconds TimeManager::turnLimit() const
+    {
+        // the search of the turn may be done already
+        const auto before = searches - (searched?1:0);
+        return (before == 0?config.firstTurnLimit:config.turnLimit);
+    }
+
+    chrono::milliseconds TimeManager::safetyMargin() const
+    {
+        return config.safetyMargin*turnLimit().count()/
+            max<chrono::milliseconds::rep>(config.turnLimit.count(), 1);
+    }
+}
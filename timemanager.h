@@ -0,0 +1,87 @@
+#ifndef TIMEMANAGER_H
+#define TIMEMANAGER_H
+
+#include <cstddef>
+#include <chrono>
+
+#include "game.h"
+
+namespace logic
+{
+    using namespace std;
+
+    struct TimeConfig
+    {
+        TimeConfig()
+            :turnLimit(game::TIME_LIMIT),
+            firstTurnLimit(game::TIME_LIMIT),
+            safetyMargin(5),
+            initialOverhead(2),
+            minSearch(1),
+            stableLevels(0)
+        {}
+
+        // the game gives the first turn game::FIRST_TIME_LIMIT, the
+        // defaults leave it to the game driver
+        chrono::milliseconds turnLimit;
+        // the limit of the first search
+        chrono::milliseconds firstTurnLimit;
+        // kept free of the measured turn time for what can't be measured:
+        // the input delivery and the scheduling under load; a longer turn
+        // builds a larger tree and keeps a proportionally larger margin
+        chrono::milliseconds safetyMargin;
+        // the overhead estimate before the first measurement
+        chrono::milliseconds initialOverhead;
+        // the search gets at least this much
+        chrono::milliseconds minSearch;
+        // the tree search stops once the best command hasn't changed for
+        // this many completed levels, 0 to search until the deadline
+        size_t stableLevels;
+    };
+
+    // Budgets the search of every turn. The turn clock starts when the
+    // input begins to arrive, the time of the turn outside the search
+    // (parsing, dropping the old tree, writing the output) is measured
+    // and kept out of the next budgets.
+    class TimeManager
+    {
+    public:
+        using Clock = chrono::steady_clock;
+
+        TimeManager(const TimeConfig &config = TimeConfig());
+
+        // the first input of the turn is read
+        void startTurn();
+        // starts the turn unless it's started, returns the search time
+        chrono::milliseconds beginSearch();
+        void endSearch();
+        // the output of the turn is written
+        void endTurn();
+
+        const TimeConfig &getConfig() const
+        {
+            return config;
+        }
+
+    private:
+        chrono::milliseconds turnLimit() const;
+        chrono::milliseconds safetyMargin() const;
+
+        TimeConfig config;
+        size_t turn;
+        // the first turn is the one of the first search, whatever turn
+        // marks came before it
+        size_t searches;
+        bool turnStarted;
+        bool searched;
+        Clock::time_point turnBegin;
+        Clock::time_point searchBegin;
+        Clock::time_point searchEnd;
+        chrono::milliseconds searchLimit;
+        // estimate of the turn time after the search and of the search
+        // overrun, follows a rise at once and a drop slowly
+        Clock::duration overhead;
+    };
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include "transposition.h"
+
+#include <cassert>
+
+namespace optimizer
+{
+    TranspositionTable::TranspositionTable(size_t memoryBudget,
+        ReplacePolicy policy)
+        :entries(), mask(0), policy(policy), generation(1),
+        clearGeneration(1), count(0), replacedCount(0)
+    {
+        size_t sz = BUCKET_SIZE;
+        while(sz*2*sizeof(Entry) <= memoryBudget)
+            sz *= 2;
+        entries.resize(sz, Entry{0, 0, 0});
+        mask = sz-1;
+    }
+
+    bool TranspositionTable::insert(StateHash key, size_t depth)
+    {
+        key = storedKey(key);
+        const auto begin = bucketBegin(key);
+        auto freeIdx = entries.size();
+        for(size_t i = begin; i < begin+BUCKET_SIZE; ++i)
+        {
+            auto &e = entries[i];
+            if(isEmpty(e))
+            {
+                if(freeIdx == entries.size())
+                    freeIdx = i;
+            }
+            else if(e.key == key)
+            {
+                return false;
+            }
+        }
+        const Entry entry{key, static_cast<uint32_t>(depth), generation};
+        if(freeIdx != entries.size())
+        {
+            entries[freeIdx] = entry;
+            ++count;
+            return true;
+        }
+        const auto victimIdx = selectVictim(begin);
+        auto &victim = entries[victimIdx];
+        if(policy == REPLACE_DEEPEST && victim.depth < entry.depth)
+            return true;
+        victim = entry;
+        ++replacedCount;
+        return true;
+    }
+
+    bool TranspositionTable::contains(StateHash key) const
+    {
+        key = storedKey(key);
+        const auto begin = bucketBegin(key);
+        for(size_t i = begin; i < begin+BUCKET_SIZE; ++i)
+        {
+            const auto &e = entries[i];
+            if(!isEmpty(e) && e.key == key)
+                return true;
+        }
+        return false;
+    }
+
+    void TranspositionTable::clear()
+    {
+        nextGeneration();
+        clearGeneration = generation;
+        count = 0;
+    }
+
+    void TranspositionTable::nextGeneration()
+    {
+        ++generation;
+        assert(generation != 0);
+    }
+
+    size_t TranspositionTable::selectVictim(size_t begin) const
+    {
+        auto victimIdx = begin;
+        if(policy == REPLACE_ALWAYS)
+            return victimIdx;
+        for(size_t i = begin+1; i < begin+BUCKET_SIZE; ++i)
+        {
+            const auto &e = entries[i];
+            const auto &victim = entries[victimIdx];
+            if(policy == REPLACE_OLDEST && e.generation != victim.generation)
+            {
+                if(e.generation < victim.generation)
+                    victimIdx = i;
+            }
+            else if(e.depth > victim.depth)
+            {
+                victimIdx = i;
+            }
+        }
+        return victimIdx;
+    }
+}
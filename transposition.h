@@ -0,0 +1,91 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "hash.h"
+
+namespace optimizer
+{
+    using namespace std;
+
+    using StateHash = hashing::Hash;
+    using hashing::mixHash;
+    using hashing::combineHash;
+
+    // Fixed size open addressing set of state hashes. Collisions inside a
+    // bucket are resolved by the replacement policy, so a forgotten state
+    // may be reported as new again.
+    class TranspositionTable
+    {
+    public:
+        enum ReplacePolicy
+        {
+            // evict the first entry of the bucket
+            REPLACE_ALWAYS,
+            // evict the deepest entry, keep the new one only if it isn't deeper
+            REPLACE_DEEPEST,
+            // evict the entry from the oldest generation, deepest among them
+            REPLACE_OLDEST
+        };
+
+        TranspositionTable(size_t memoryBudget, ReplacePolicy policy);
+
+        // returns false if the state is already stored
+        bool insert(StateHash key, size_t depth);
+        bool contains(StateHash key) const;
+        // forgets all stored states
+        void clear();
+        // following inserts are newer than everything stored before
+        void nextGeneration();
+
+        size_t capacity() const
+        {
+            return entries.size();
+        }
+        size_t size() const
+        {
+            return count;
+        }
+        size_t replaced() const
+        {
+            return replacedCount;
+        }
+
+    private:
+        static const size_t BUCKET_SIZE = 4;
+
+        struct Entry
+        {
+            StateHash key;
+            uint32_t depth;
+            uint32_t generation;
+        };
+
+        bool isEmpty(const Entry &e) const
+        {
+            return e.key == 0 || e.generation < clearGeneration;
+        }
+        size_t bucketBegin(StateHash key) const
+        {
+            return static_cast<size_t>(key) & mask & ~(BUCKET_SIZE-1);
+        }
+        static StateHash storedKey(StateHash key)
+        {
+            return key != 0?key:1;
+        }
+        size_t selectVictim(size_t begin) const;
+
+        vector<Entry> entries;
+        size_t mask;
+        ReplacePolicy policy;
+        uint32_t generation;
+        uint32_t clearGeneration;
+        size_t count;
+        size_t replacedCount;
+    };
+}
+
+#endif